@@ -5,9 +5,11 @@
 #include "HybridEstimator.h"
 #include "globals.h"
 #include "data.h"
+#include "lib/bfs_scratch.h"
+#include <queue>
 using namespace std;
 
-HybridEstimator::HybridEstimator(const std::vector<std::vector<int>>& _graph, int* _degree,
+HybridEstimator::HybridEstimator(const CSRGraph& _graph, int* _degree,
 		vector<bool>& _noneed, int _sum_bound,
 		const vector<int>& _approx_result):
 	SumEstimator(_graph), degree(_degree),
@@ -35,19 +37,22 @@ void HybridEstimator::init() {
 
 void HybridEstimator::bfs_depth(int d) {
 	depth = d;
-#pragma omp parallel for schedule(dynamic) num_threads(2)
-	REP(i, np) {
-		if (not noneed[i])
-			result[i] = d3_estimate(i, d);
-		else
-			result[i] = 1e9;
-	}
+	threadpool->parallel_for(0, np,
+			bind(&HybridEstimator::bfs_depth_one, this, d, placeholders::_1));
+}
+
+void HybridEstimator::bfs_depth_one(int d, int i) {
+	if (not noneed[i])
+		result[i] = d3_estimate(i, d);
+	else
+		result[i] = 1e9;
 }
 
 int HybridEstimator::d3_estimate(int source, int depth_max) {
-	std::vector<bool> hash(np);
-	std::queue<int> q;
-	hash[source] = true;
+	BFSScratch& bs = BFSScratch::local();
+	bs.start(np);
+	auto& q = bs.queue;
+	bs.visited.set(source);
 	q.push(source);
 	int s = 0;
 	int nr_remain = degree[source];
@@ -58,13 +63,10 @@ int HybridEstimator::d3_estimate(int source, int depth_max) {
 		if (depth == depth_max)
 			break;
 		REP(_, qsize) {
-			int v0 = q.front(); q.pop();
-			FOR_ITR(v1, graph[v0]) {
-				if (hash[*v1])
-					continue;
-				hash[*v1] = true;
-				q.push(*v1);
-			}
+			int v0 = q.pop();
+			FOR_ITR(v1, graph[v0])
+				if (bs.visited.test_and_set(*v1))
+					q.push(*v1);
 		}
 	}
 	s += nr_remain * (depth_max + 1);
@@ -130,22 +132,9 @@ void HybridEstimator::bfs_2_dp_1() {
 		int nr_idle = threadpool->get_nr_idle_thread();
 		if (nr_idle) {
 			print_debug("Idle thread: %d\n", nr_idle);
-#pragma omp parallel for schedule(dynamic) num_threads(2)
-			REP(i, np) {
-				if (noneed[i]) continue;
-				if (result[i] == 0) continue;
-				if (nr_remain[i] == 0) continue;
-				Bitset s(len);
-				FOR_ITR(fr, graph[i])
-					s.or_arr(s_prev[*fr], len);
-				s.and_not_arr(s_prev[i], len);
-
-				int c = s.count(len);
-				result[i] += c * 3;
-				nr_remain[i] -= c;
-				result[i] += nr_remain[i] * 4;
-				s.free();
-			}
+			threadpool->parallel_for(0, np,
+					bind(&HybridEstimator::union_one, this, ref(s_prev), len, 3,
+						placeholders::_1));
 		} else {
 			Bitset s(len);
 			REP(i, np) {
@@ -181,45 +170,9 @@ void HybridEstimator::bfs_3_dp_1() {
 	cutcnt = 0;
 	{
 		TotalTimer ttt("bfs depth 3");
-#pragma omp parallel for schedule(dynamic) num_threads(2)
-		REP(i, np) {
-			std::queue<int> q;
-			q.push(i);
-			s_prev[i].set(i);
-			int s = 0;
-			for (int depth = 0; !q.empty(); depth ++) {
-				int qsize = (int)q.size();
-				s += depth * qsize;
-				nr_remain[i] -= qsize;
-				if (depth == 3)
-					break;
-				REP(_, qsize) {
-					int v0 = q.front(); q.pop();
-					FOR_ITR(v1, graph[v0]) {
-						if (s_prev[i].get_and_set(*v1))
-							continue;
-						q.push(*v1);
-					}
-				}
-			}
-			result[i] = s;
-			s += nr_remain[i] * 4;
-			m_assert(s == d3_estimate(i, 3));
-			d3_result[i] = s;
-			/*
-			 *if (not noneed[i]) {
-			 *    // XXX this is wrong
-			 *    int n3_upper = (int)sum_dv2 - (int)sum_dv1 + (int)graph[i].size() + 1;
-			 *    m_assert(n3_upper >= 0);
-			 *    int est_s_lowerbound = result[i] + n3_upper * 3 + (nr_remain[i] - n3_upper) * 4;
-			 *    if (est_s_lowerbound > sum_bound) {		// cut
-			 *        noneed[i] = true;
-			 *        cutcnt ++;
-			 *        result[i] = 1e9;
-			 *    }
-			 *}
-			 */
-		}
+		threadpool->parallel_for(0, np,
+				bind(&HybridEstimator::bfs_3_one, this, ref(s_prev), ref(d3_result),
+					placeholders::_1));
 	}
 
 	if (good_err(d3_result)) {
@@ -234,22 +187,9 @@ void HybridEstimator::bfs_3_dp_1() {
 		int nr_idle = threadpool->get_nr_idle_thread();
 		if (nr_idle) {
 			print_debug("Idle thread: %d\n", nr_idle);
-#pragma omp parallel for schedule(dynamic) num_threads(2)
-			REP(i, np) {
-				if (noneed[i]) continue;
-				if (result[i] == 0) continue;
-				if (nr_remain[i] == 0) continue;
-				Bitset s(len);
-				FOR_ITR(fr, graph[i])
-					s.or_arr(s_prev[*fr], len);
-				s.and_not_arr(s_prev[i], len);
-
-				int c = s.count(len);
-				result[i] += c * 4;
-				nr_remain[i] -= c;
-				result[i] += nr_remain[i] * 5;
-				s.free();
-			}
+			threadpool->parallel_for(0, np,
+					bind(&HybridEstimator::union_one, this, ref(s_prev), len, 4,
+						placeholders::_1));
 		} else {
 			Bitset s(len);
 			REP(i, np) {
@@ -325,17 +265,9 @@ void HybridEstimator::bfs_2_dp_more(bool use_4) {
 	BitBoard s(np);
 	depth = 3;
 	TotalTimer ttt("Depth 3+");
-#pragma omp parallel for schedule(dynamic) num_threads(2)
-	REP(i, np) {
-		s[i].reset(len);
-		FOR_ITR(fr, graph[i])
-			s[i].or_arr(s_prev[*fr], len);
-		s[i].and_not_arr(s_prev[i], len);
-		int c = s[i].count(len);
-		result[i] += c * depth;
-		nr_remain[i] -= c;
-		tmp_result[i] = result[i] + nr_remain[i] * (depth + 1);
-	}
+	threadpool->parallel_for(0, np,
+			bind(&HybridEstimator::dp_one, this, ref(s), ref(s_prev), len,
+				ref(tmp_result), placeholders::_1));
 
 	// judge whether tmp_result is accurate enough
 
@@ -346,31 +278,86 @@ void HybridEstimator::bfs_2_dp_more(bool use_4) {
 		depth ++;
 		s.swap(s_prev);
 		s.free();
-#pragma omp parallel for schedule(dynamic) num_threads(2)
-		REP(i, np) {
-			if (noneed[i]) continue;
-			if (result[i] == 0) continue;
-			if (nr_remain[i] == 0) continue;
-			Bitset ss(len);
-			FOR_ITR(fr, graph[i])
-				ss.or_arr(s_prev[*fr], len);
-			ss.and_not_arr(s_prev[i], len);
-			int c = ss.count(len);
-			result[i] += c * depth;
-			nr_remain[i] -= c;
-			result[i] += nr_remain[i] * (depth + 1);
-			ss.free();
-		}
+		threadpool->parallel_for(0, np,
+				bind(&HybridEstimator::union_one, this, ref(s_prev), len, depth,
+					placeholders::_1));
 	} else {
 		result = move(tmp_result);
 	}
 	s_prev.free();
 }
 
+void HybridEstimator::bfs_3_one(BitBoard& s_prev, vector<int>& d3_result, int i) {
+	std::queue<int> q;
+	q.push(i);
+	s_prev[i].set(i);
+	int s = 0;
+	for (int depth = 0; !q.empty(); depth ++) {
+		int qsize = (int)q.size();
+		s += depth * qsize;
+		nr_remain[i] -= qsize;
+		if (depth == 3)
+			break;
+		REP(_, qsize) {
+			int v0 = q.front(); q.pop();
+			FOR_ITR(v1, graph[v0]) {
+				if (s_prev[i].get_and_set(*v1))
+					continue;
+				q.push(*v1);
+			}
+		}
+	}
+	result[i] = s;
+	s += nr_remain[i] * 4;
+	m_assert(s == d3_estimate(i, 3));
+	d3_result[i] = s;
+	/*
+	 *if (not noneed[i]) {
+	 *    // XXX this is wrong
+	 *    int n3_upper = (int)sum_dv2 - (int)sum_dv1 + (int)graph[i].size() + 1;
+	 *    m_assert(n3_upper >= 0);
+	 *    int est_s_lowerbound = result[i] + n3_upper * 3 + (nr_remain[i] - n3_upper) * 4;
+	 *    if (est_s_lowerbound > sum_bound) {		// cut
+	 *        noneed[i] = true;
+	 *        cutcnt ++;
+	 *        result[i] = 1e9;
+	 *    }
+	 *}
+	 */
+}
+
+void HybridEstimator::union_one(BitBoard& s_prev, int len, int d, int i) {
+	if (noneed[i]) return;
+	if (result[i] == 0) return;
+	if (nr_remain[i] == 0) return;
+	Bitset s(len);
+	FOR_ITR(fr, graph[i])
+		s.or_arr(s_prev[*fr], len);
+	s.and_not_arr(s_prev[i], len);
+
+	int c = s.count(len);
+	result[i] += c * d;
+	nr_remain[i] -= c;
+	result[i] += nr_remain[i] * (d + 1);
+	s.free();
+}
+
+void HybridEstimator::dp_one(BitBoard& s, BitBoard& s_prev, int len,
+		vector<int>& tmp_result, int i) {
+	s[i].reset(len);
+	FOR_ITR(fr, graph[i])
+		s[i].or_arr(s_prev[*fr], len);
+	s[i].and_not_arr(s_prev[i], len);
+	int c = s[i].count(len);
+	result[i] += c * depth;
+	nr_remain[i] -= c;
+	tmp_result[i] = result[i] + nr_remain[i] * (depth + 1);
+}
+
 #if 0
 
 VectorMergeHybridEstimator::VectorMergeHybridEstimator(
-		const std::vector<std::vector<int>>& _graph, int* _degree,
+		const CSRGraph& _graph, int* _degree,
 		vector<bool>& _noneed, int _sum_bound,
 		const vector<int>& _approx_result):
 	HybridEstimator(_graph, _degree, _noneed, _sum_bound, _approx_result)
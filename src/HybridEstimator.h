@@ -19,7 +19,7 @@ class HybridEstimator: public SumEstimator {
 		const std::vector<int>& approx_result;
 
 
-		HybridEstimator(const std::vector<std::vector<int>>& _graph, int* _degree,
+		HybridEstimator(const CSRGraph& _graph, int* _degree,
 				std::vector<bool>& noneed, int sum_bound,
 				const std::vector<int>& _approx_result);
 
@@ -35,6 +35,14 @@ class HybridEstimator: public SumEstimator {
 
 		int d3_estimate(int source, int d);
 
+		// bodies of the loops over all vertices, run by threadpool->parallel_for
+		void bfs_depth_one(int d, int i);
+		void bfs_3_one(BitBoard& s_prev, std::vector<int>& d3_result, int i);
+		// add distance d of vertices first reached through neighbors
+		void union_one(BitBoard& s_prev, int len, int d, int i);
+		void dp_one(BitBoard& s, BitBoard& s_prev, int len,
+				std::vector<int>& tmp_result, int i);
+
 		int estimate(int i) { return result[i]; }
 
 		// error between result[] ans approx_result[]
@@ -76,7 +84,7 @@ class HybridEstimator: public SumEstimator {
  *
  *class VectorMergeHybridEstimator: public HybridEstimator{
  *    public:
- *        VectorMergeHybridEstimator(const std::vector<std::vector<int>>& _graph, int* _degree,
+ *        VectorMergeHybridEstimator(const CSRGraph& _graph, int* _degree,
  *                std::vector<bool>& noneed, int sum_bound,
  *                const std::vector<int>& _approx_result);
  *
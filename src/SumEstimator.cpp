@@ -8,27 +8,29 @@
 #include "SumEstimator.h"
 #include "lib/common.h"
 #include "lib/utils.h"
+#include "lib/bfs_scratch.h"
+#include "closeness_batch.h"
+#include "globals.h"
 using namespace std;
 using namespace boost;
 
 
 
 int SumEstimator::get_exact_s(int source) {
-	std::vector<bool> hash(np);
-	std::queue<int> q;
-	hash[source] = true;
+	BFSScratch& bs = BFSScratch::local();
+	bs.start(np);
+	auto& q = bs.queue;
+	bs.visited.set(source);
 	q.push(source);
 	int s = 0;
 	for (int depth = 0; !q.empty(); depth ++) {
 		int qsize = (int)q.size();
 		s += depth * qsize;
 		for (int i = 0; i < qsize; i ++) {
-			int v0 = q.front(); q.pop();
-			FOR_ITR(itr, graph[v0]) {
-				if (hash[*itr]) continue;
-				hash[*itr] = true;
-				q.push(*itr);
-			}
+			int v0 = q.pop();
+			FOR_ITR(itr, graph[v0])
+				if (bs.visited.test_and_set(*itr))
+					q.push(*itr);
 		}
 	}
 	return s;
@@ -39,7 +41,6 @@ void SumEstimator::error() {
 	double ret = 0;
 	int pos_cnt = 0;
 	ofstream fout("/tmp/" + string_format("%d", np) + ".txt");
-#pragma omp parallel for schedule(static) num_threads(4)
 	REP(i, np) {
 		auto est = estimate(i);
 		auto truth = get_exact_s(i);
@@ -50,7 +51,6 @@ void SumEstimator::error() {
 				__sync_fetch_and_add(&pos_cnt, 1);
 			if (fabs(err) > 0.05)
 				print_debug("Error: %lf, truth: %d, est: %d, np: %d\n", err, truth, est, np);
-#pragma omp critical
 			ret += fabs(err);
 		}
 	}
@@ -62,21 +62,31 @@ void RandomChoiceEstimator::work() {
 	vector<int> vst_cnt(np, 0);
 	auto n = samples.size();
 	vector<int> true_result(n);
-#pragma omp parallel for schedule(dynamic) num_threads(2)
-	REP(i, n)
-		true_result[i] = bfs_all(samples[i], &vst_cnt);
+	threadpool->parallel_for(0, (int)n,
+			bind(&RandomChoiceEstimator::sample_one, this, &vst_cnt, &true_result,
+				placeholders::_1), 1);
 
+	vector<int> unseen;
 	REP(i, np) {
 		if (vst_cnt[i] == 0)
-			result[i] = get_exact_s(i);
+			unseen.emplace_back(i);
 		else {
 			result[i] = result[i] * degree[i] / vst_cnt[i];
 		}
 	}
+	vector<int> s(unseen.size());
+	batch_exact_s(graph, unseen.data(), (int)unseen.size(), s.data());
+	REP(i, unseen.size())
+		result[unseen[i]] = s[i];
 	REP(i, n)
 		result[samples[i]] = true_result[i];
 }
 
+void RandomChoiceEstimator::sample_one(vector<int>* vst_cnt,
+		vector<int>* true_result, int i) {
+	(*true_result)[i] = bfs_all(samples[i], vst_cnt);
+}
+
 int RandomChoiceEstimator::bfs_all(int source, vector<int>* vst_cnt) {
 	int sum = 0;
 	queue<int> q;
@@ -103,7 +113,7 @@ int RandomChoiceEstimator::bfs_all(int source, vector<int>* vst_cnt) {
 }
 
 SSEUnionSetEstimator::SSEUnionSetEstimator(
-		const vector<vector<int>>& _graph,
+		const CSRGraph& _graph,
 		int* degree, int _depth_max) :SumEstimator(_graph), depth_max(_depth_max) {
 	//DEBUG_DECL(Timer, init);
 	Timer init;
@@ -125,41 +135,45 @@ SSEUnionSetEstimator::SSEUnionSetEstimator(
 	result.resize((size_t)np, 0);
 	nr_remain.resize(np);
 
-#pragma omp parallel for schedule(static) num_threads(4)
-	REP(i, np) {
-		s_prev[i].set(i);
-		FOR_ITR(fr, graph[i])
-			s_prev[i].set(*fr);
-		result[i] += (int)graph[i].size();
-		nr_remain[i] = degree[i] - 1 - (int)graph[i].size();
-	}
+	threadpool->parallel_for(0, np,
+			bind(&SSEUnionSetEstimator::init_one, this, degree, placeholders::_1));
 	work();
 }
 
+void SSEUnionSetEstimator::init_one(int* degree, int i) {
+	s_prev[i].set(i);
+	FOR_ITR(fr, graph[i])
+		s_prev[i].set(*fr);
+	result[i] += (int)graph[i].size();
+	nr_remain[i] = degree[i] - 1 - (int)graph[i].size();
+}
+
 void SSEUnionSetEstimator::work() {
 	DEBUG_DECL(TotalTimer, uniont("sse"));
 	int len = get_len_from_bit(np);
 	for (int k = 2; k <= depth_max; k ++) {
-#pragma omp parallel for schedule(static) num_threads(4)
-		REP(i, np) {
-			s[i].reset(len);
-			FOR_ITR(fr, graph[i])
-				s[i].or_arr(s_prev[*fr], len);
-			s[i].and_not_arr(s_prev[i], len);
-
-			int c = s[i].count(len);
-			result[i] += c * k;
-			nr_remain[i] -= c;
-			s[i].or_arr(s_prev[i], len);
-		}
+		threadpool->parallel_for(0, np,
+				bind(&SSEUnionSetEstimator::union_one, this, len, k, placeholders::_1));
 		s.swap(s_prev);
 	}
 	REP(i, np)
 		result[i] += nr_remain[i] * (depth_max + 1);
 }
 
+void SSEUnionSetEstimator::union_one(int len, int k, int i) {
+	s[i].reset(len);
+	FOR_ITR(fr, graph[i])
+		s[i].or_arr(s_prev[*fr], len);
+	s[i].and_not_arr(s_prev[i], len);
+
+	int c = s[i].count(len);
+	result[i] += c * k;
+	nr_remain[i] -= c;
+	s[i].or_arr(s_prev[i], len);
+}
+
 
-LimitDepthEstimator::LimitDepthEstimator(const std::vector<std::vector<int>>& _graph, int* _degree, int _depth_max):
+LimitDepthEstimator::LimitDepthEstimator(const CSRGraph& _graph, int* _degree, int _depth_max):
 	SumEstimator(_graph), degree(_degree), depth_max(_depth_max)
 { }
 
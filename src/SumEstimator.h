@@ -8,6 +8,7 @@
 #include <numeric>
 #include <boost/dynamic_bitset.hpp>
 #include "lib/common.h"
+#include "lib/csr_graph.h"
 #include "lib/bitset.h"
 #include "lib/Timer.h"
 #include "lib/debugutils.h"
@@ -15,10 +16,10 @@
 
 class SumEstimator {
 	public:
-		const std::vector<std::vector<int>>& graph;
+		const CSRGraph& graph;
 		int np;
 
-		SumEstimator(const std::vector<std::vector<int>>& _graph)
+		SumEstimator(const CSRGraph& _graph)
 			: graph(_graph), np((int)graph.size()) { }
 
 		virtual int estimate(int i) = 0;
@@ -37,7 +38,7 @@ class RandomChoiceEstimator: public SumEstimator {
 		int* degree;
 
 		// p: percent of point to randomly choose. 0 < p < 1
-		RandomChoiceEstimator(const std::vector<std::vector<int>>& _graph, int* _degree, double p)
+		RandomChoiceEstimator(const CSRGraph& _graph, int* _degree, double p)
 			: SumEstimator(_graph),
 			result(np, 0), degree(_degree)
 		{
@@ -53,6 +54,8 @@ class RandomChoiceEstimator: public SumEstimator {
 
 		void work();
 		int bfs_all(int source, std::vector<int>*);
+		// bfs_all of samples[i], run by threadpool->parallel_for
+		void sample_one(std::vector<int>* vst_cnt, std::vector<int>* true_result, int i);
 
 		int estimate(int i) { return result[i]; }
 
@@ -68,8 +71,11 @@ class SSEUnionSetEstimator: public SumEstimator {
 		std::vector<int> result;
 		std::vector<int> nr_remain;
 
-		SSEUnionSetEstimator(const std::vector<std::vector<int>>& _graph, int* degree, int _depth_max);
+		SSEUnionSetEstimator(const CSRGraph& _graph, int* degree, int _depth_max);
 		void work();
+		// bodies of the loops over all vertices
+		void init_one(int* degree, int i);
+		void union_one(int len, int k, int i);
 
 		int estimate(int i) { return result[i]; }
 };
@@ -79,7 +85,7 @@ class LimitDepthEstimator: public SumEstimator {
 		int* degree;
 		int depth_max;
 
-		LimitDepthEstimator(const std::vector<std::vector<int>>& _graph, int* _degree, int depth_max);
+		LimitDepthEstimator(const CSRGraph& _graph, int* _degree, int depth_max);
 
 		int estimate(int i);
 };
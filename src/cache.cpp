@@ -22,7 +22,7 @@ const NeighborT& CachedNeighbor::get_neighbor_1(int person) {
 #ifdef GOOGLE_HASH
 	ret.set_empty_key(-1);
 #endif
-	auto& friends = Data::friends[person];
+	auto friends = Data::friends[person];
 	FOR_ITR(itr, friends) {
 		ret.insert(itr->pid);
 	}
@@ -45,7 +45,7 @@ const NeighborT& CachedNeighbor::get_neighbor_2(int person) {
 	ret.set_empty_key(-1);
 #endif
 	FOR_ITR(itr, n1) {
-		auto& f = Data::friends[*itr];
+		auto f = Data::friends[*itr];
 		FOR_ITR(p, f) {
 			if (p->pid != person && n1.count(p->pid) == 0)
 				ret.insert(p->pid);
@@ -0,0 +1,64 @@
+//File: closeness_batch.cpp
+//Date: Sun Oct 18 01:05:37 2026 +0000
+
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include "closeness_batch.h"
+#include "lib/common.h"
+#include "lib/debugutils.h"
+#include "lib/bfs_scratch.h"
+using namespace std;
+
+namespace {
+	// at most CLOSENESS_BATCH distinct sources
+	void search(const CSRGraph& g, const int* sources, int n, int* s) {
+		BFSScratch& bs = BFSScratch::local();
+		bs.reserve_masks(g.size());
+		uint64_t *seen = bs.seen.data(), *frontier = bs.frontier.data(),
+				 *next = bs.next.data();
+		auto& active = bs.active;
+		auto& touched = bs.touched;
+		active.clear();
+		REP(i, n) {
+			int v = sources[i];
+			if (frontier[v] == 0) active.emplace_back(v);
+			frontier[v] |= 1ULL << i;
+			seen[v] |= 1ULL << i;
+			s[i] = 0;
+		}
+
+		for (int depth = 1; not active.empty(); depth ++) {
+			touched.clear();
+			FOR_ITR(v, active) {
+				uint64_t f = frontier[*v];
+				FOR_ITR(u, g[*v]) {
+					if (not (f & ~seen[*u])) continue;
+					if (next[*u] == 0) touched.emplace_back(*u);
+					next[*u] |= f;
+				}
+			}
+			FOR_ITR(v, active) frontier[*v] = 0;
+			active.clear();
+			FOR_ITR(u, touched) {
+				uint64_t nw = next[*u] & ~seen[*u];
+				next[*u] = 0;
+				if (nw == 0) continue;
+				seen[*u] |= nw;
+				frontier[*u] = nw;
+				active.emplace_back(*u);
+				for (; nw; nw &= nw - 1)
+					s[__builtin_ctzll(nw)] += depth;
+			}
+		}
+
+		// frontier and next are all zero again
+		memset(seen, 0, sizeof(uint64_t) * g.size());
+	}
+}
+
+void batch_exact_s(const CSRGraph& g, const int* sources, int n, int* s) {
+	for (int b = 0; b < n; b += CLOSENESS_BATCH)
+		search(g, sources + b, min(CLOSENESS_BATCH, n - b), s + b);
+}
@@ -0,0 +1,16 @@
+//File: closeness_batch.h
+//Date: Sun Oct 18 01:05:37 2026 +0000
+
+
+#pragma once
+#include "lib/csr_graph.h"
+
+// sources handled by one search, one bit each
+const int CLOSENESS_BATCH = 64;
+
+// Exact sum of distances from each of the n sources to the vertices it
+// reaches, written to s[0 ... n-1].
+// Sources are searched CLOSENESS_BATCH at a time by a single bit-parallel
+// BFS: every vertex keeps a word of the sources that reached it, and one
+// scan of the adjacency of a frontier vertex advances all of them at once.
+void batch_exact_s(const CSRGraph& g, const int* sources, int n, int* s);
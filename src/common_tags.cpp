@@ -0,0 +1,35 @@
+//File: common_tags.cpp
+//Date: Sat Oct 17 23:26:02 2026 +0000
+
+
+#include <mutex>
+
+#include "common_tags.h"
+#include "data.h"
+#include "lib/utils.h"
+using namespace std;
+
+vector<int> PersonTags::offset;
+vector<uint32_t> PersonTags::tag;
+
+namespace {
+	once_flag built;
+
+	void do_build(vector<int>* offset, vector<uint32_t>* tag) {
+		offset->resize(Data::nperson + 1);
+		(*offset)[0] = 0;
+		REP(i, Data::nperson)
+			(*offset)[i + 1] = (*offset)[i] + (int)Data::tags[i].size();
+		tag->resize(offset->back());
+		REP(i, Data::nperson)
+			copy(Data::tags[i].begin(), Data::tags[i].end(), tag->begin() + (*offset)[i]);
+	}
+}
+
+void PersonTags::build()
+{ call_once(built, do_build, &offset, &tag); }
+
+void PersonTags::free() {
+	FreeAll(offset);
+	FreeAll(tag);
+}
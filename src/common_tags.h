@@ -0,0 +1,34 @@
+//File: common_tags.h
+//Date: Sat Oct 17 23:26:02 2026 +0000
+
+
+#pragma once
+#include <vector>
+#include <cstdint>
+
+#include "lib/intersect.h"
+
+// Interest tags of every person as one sorted uint32 array each, laid out
+// in CSR form, so that counting common tags of two persons is a SIMD
+// intersection instead of walking two std::set.
+class PersonTags {
+	public:
+		// from Data::tags, which must be complete. only the first call builds
+		static void build();
+		static void free();
+
+		static int common(int u, int v) {
+			const uint32_t* t = tag.data();
+			return intersect_count(t + offset[u], offset[u + 1] - offset[u],
+					t + offset[v], offset[v + 1] - offset[v]);
+		}
+
+	private:
+		static std::vector<int> offset;
+		static std::vector<uint32_t> tag;
+};
+
+// number of interest tags shared by persons u and v.
+// PersonTags::build() must have been called
+inline int common_tags(int u, int v)
+{ return PersonTags::common(u, v); }
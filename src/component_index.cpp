@@ -0,0 +1,84 @@
+//File: component_index.cpp
+//Date: Sat Oct 17 20:14:47 2026 +0000
+
+
+#include <algorithm>
+#include <functional>
+
+#include "component_index.h"
+#include "data.h"
+#include "lib/common.h"
+#include "lib/Timer.h"
+using namespace std;
+
+namespace {
+	int find(vector<int>& f, int x) {
+		while (f[x] != x) {
+			f[x] = f[f[x]];
+			x = f[x];
+		}
+		return x;
+	}
+}
+
+namespace {
+	// each edge once, sorted by ncmts descending
+	void sorted_edges(vector<pair<int, PII>>& edges) {
+		auto& g = Data::friends;
+		REP(i, Data::nperson)
+			for (int j = g.offset[i]; j < g.offset[i + 1]; j ++)
+				if (i < g.pid[j])
+					edges.emplace_back(g.ncmts[j], make_pair(i, g.pid[j]));
+		sort(edges.begin(), edges.end(), greater<pair<int, PII>>());
+	}
+}
+
+void ComponentIndex::build(const vector<int>& thresholds) {
+	GuardedTimer timer("build q1 component index");
+	vector<int> xs(thresholds);
+	sort(xs.begin(), xs.end(), greater<int>());
+	xs.resize(unique(xs.begin(), xs.end()) - xs.begin());
+
+	vector<pair<int, PII>> edges;		// (ncmts, (p1, p2))
+	sorted_edges(edges);
+
+	vector<int> f(Data::nperson);
+	REP(i, Data::nperson) f[i] = i;
+
+	slot.clear();
+	label.assign(xs.size(), vector<int>(Data::nperson));
+	size_t e = 0;
+	REP(s, xs.size()) {
+		for (; e < edges.size() and edges[e].first > xs[s]; e ++) {
+			int a = find(f, edges[e].second.first), b = find(f, edges[e].second.second);
+			if (a != b) f[a] = b;
+		}
+
+		auto& l = label[s];		// the root of each component as its id
+		REP(i, Data::nperson)
+			l[i] = find(f, i);
+		slot[xs[s]] = (int)s;
+	}
+}
+
+void ComponentIndex::build_all() {
+	GuardedTimer timer("build q1 component index of all thresholds");
+	vector<pair<int, PII>> edges;		// (ncmts, (p1, p2))
+	sorted_edges(edges);
+
+	int n = Data::nperson;
+	parent.resize(n);
+	link_ncmts.assign(n, 0);
+	vector<int> size(n, 1);
+	REP(i, n) parent[i] = i;
+	FOR_ITR(e, edges) {
+		int a = e->second.first, b = e->second.second;
+		while (parent[a] != a) a = parent[a];
+		while (parent[b] != b) b = parent[b];
+		if (a == b) continue;
+		if (size[a] > size[b]) swap(a, b);
+		parent[a] = b;
+		link_ncmts[a] = e->first;
+		size[b] += size[a];
+	}
+}
@@ -0,0 +1,47 @@
+//File: component_index.h
+//Date: Sat Oct 17 20:14:47 2026 +0000
+
+
+#pragma once
+#include <vector>
+#include <map>
+
+// Connected components of the knows graph restricted to edges with
+// ncmts > x, for every threshold x asked by Query 1.
+// Built by one union-find sweep with x going from high to low,
+// since each lower threshold only adds edges.
+class ComponentIndex {
+	public:
+		// thresholds: every x that will be asked, in any order
+		void build(const std::vector<int>& thresholds);
+
+		// all thresholds at once, when they are not known in advance.
+		// the union find of the sweep is kept, without path compression:
+		// each link remembers the ncmts of the edge that made it, and links
+		// made later never have a larger one
+		void build_all();
+
+		bool has(int x) const { return not parent.empty() or slot.count(x); }
+
+		// whether p1 and p2 may be connected under x. x must be built
+		bool connected(int x, int p1, int p2) const {
+			if (not parent.empty())
+				return root(x, p1) == root(x, p2);
+			const std::vector<int>& c = label[slot.find(x)->second];
+			return c[p1] == c[p2];
+		}
+
+	private:
+		std::map<int, int> slot;		// x -> index in label
+		std::vector<std::vector<int>> label;		// label[s][p]: component id of p
+
+		// of build_all, union by size keeps the paths O(log n) long
+		std::vector<int> parent, link_ncmts;
+
+		// the links existing under x are those with ncmts > x
+		int root(int x, int p) const {
+			while (parent[p] != p and link_ncmts[p] > x)
+				p = parent[p];
+			return p;
+		}
+};
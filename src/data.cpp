@@ -15,12 +15,17 @@ using namespace std;
 int Data::nperson= 0;
 int Data::ntag = 0;
 int * Data::birthday = NULL;
-vector<vector<ConnectedPerson> > Data::friends;
+FriendGraph Data::friends;
 vector<TagSet> Data::tags;
 vector<vector<int> > Data::person_in_tags;
 vector<string> Data::tag_name;
+vector<int> Data::tag_rank;
 unordered_map<string, vector<int>, StringHashFunc> Data::placeid;
 vector<PlaceNode> Data::places;
+PlaceIndex Data::place_index;
+vector<vector<int>> Data::tag_forums;
+vector<vector<int>> Data::forum_members;
+unordered_map<string, int, StringHashFunc> Data::tagid;
 vector<unordered_set<int>> Data::friends_hash;
 
 #ifdef DEBUG
@@ -35,13 +40,55 @@ void Data::allocate() {
 #endif
 
 	birthday = new int[nperson];
-	friends.resize(nperson);
 	tags.resize(nperson);
 }
 
+namespace {
+	struct TagNameCmp {
+		bool operator () (int a, int b) const
+		{ return Data::tag_name[a] < Data::tag_name[b]; }
+	};
+}
+
+void Data::rank_tag_name() {
+	vector<int> by_name(ntag);
+	REP(i, ntag) by_name[i] = (int)i;
+	sort(by_name.begin(), by_name.end(), TagNameCmp());
+	tag_rank.resize(ntag);
+	REP(i, ntag) tag_rank[by_name[i]] = (int)i;
+}
+
+void Data::set_forums(const vector<vector<int>>& forum_tags,
+		vector<vector<int>>& members) {
+	tag_forums.assign(ntag, vector<int>());
+	REP(i, forum_tags.size())
+		FOR_ITR(itr, forum_tags[i])
+			tag_forums[*itr].emplace_back((int)i);
+	forum_members.swap(members);
+	REP(i, ntag) tagid[tag_name[i]] = (int)i;
+}
+
 void Data::free() {
 }
 
+void FriendGraph::sort_by_cmts() {
+	cmts_pid.resize(pid.size());
+	cmts_ncmts.resize(pid.size());
+	vector<PII> row;		// (-ncmts, pid)
+	REP(i, size()) {
+		row.clear();
+		for (int j = offset[i]; j < offset[i + 1]; j ++)
+			row.emplace_back(-ncmts[j], pid[j]);
+		sort(row.begin(), row.end());
+		int j = offset[i];
+		FOR_ITR(itr, row) {
+			cmts_ncmts[j] = -itr->first;
+			cmts_pid[j] = itr->second;
+			j ++;
+		}
+	}
+}
+
 PersonSet PlaceNode::get_all_persons() {
 	// TODO faster?
 	PersonSet ret = persons;
@@ -63,7 +110,17 @@ PersonInPlace::PersonInPlace(int _pid):
 
 vector<bool> get_tag_persons_hash(const string& s) {
 	DEBUG_DECL(TotalTimer, tt("get_tag_persons_hash"));
-	return q4_persons[s];
+	if (not server_mode)
+		return q4_persons[s];
+	// members of any forum having the tag, empty if no such tag
+	vector<bool> ret(Data::nperson, false);
+	auto itr = Data::tagid.find(s);
+	if (itr == Data::tagid.end())
+		return ret;
+	FOR_ITR(fitr, Data::tag_forums[itr->second])
+		FOR_ITR(pitr, Data::forum_members[*fitr])
+			ret[*pitr] = true;
+	return ret;
 }
 
 int cnt_tag_persons_hash(const string& s) {
@@ -13,6 +13,8 @@
 #include "globals.h"
 #include "lib/hash_lib.h"
 #include "lib/common.h"
+#include "lib/utils.h"
+#include "place_index.h"
 
 
 struct ConnectedPerson {
@@ -31,6 +33,85 @@ struct ConnectedPerson {
 	{ os << cp.pid << " " << cp.ncmts; return os; }
 };
 
+class FriendGraph {
+// Compressed sparse row adjacency list of the knows graph.
+// friends of person i are pid[offset[i]] ... pid[offset[i + 1] - 1] (sorted by 'id'),
+// ncmts[] is parallel to pid[]
+public:
+	std::vector<int> offset;		// size nperson + 1
+	std::vector<int> pid;
+	std::vector<int> ncmts;
+
+	// the same rows sorted by ncmts descending, filled by sort_by_cmts()
+	// once ncmts is known. a search with threshold x stops at the first ncmts <= x
+	std::vector<int> cmts_pid;
+	std::vector<int> cmts_ncmts;
+
+	// one edge, seen through an iterator; ncmts is writable
+	struct EdgeRef {
+		int pid;
+		int& ncmts;
+		EdgeRef(int _pid, int& _ncmts):
+			pid(_pid), ncmts(_ncmts){}
+		EdgeRef* operator -> () { return this; }
+	};
+
+	class Iterator {
+		const int* p;
+		int* c;
+	public:
+		Iterator(const int* _p, int* _c):
+			p(_p), c(_c){}
+
+		EdgeRef operator -> () const { return EdgeRef(*p, *c); }
+		EdgeRef operator * () const { return EdgeRef(*p, *c); }
+		Iterator& operator ++ () { ++ p, ++ c; return *this; }
+		Iterator operator ++ (int) { Iterator r = *this; ++ p, ++ c; return r; }
+		bool operator != (const Iterator& r) const { return p != r.p; }
+		bool operator == (const Iterator& r) const { return p == r.p; }
+	};
+
+	// friends of one person
+	class Adjacency {
+		const int* p;
+		int* c;
+		int n;
+	public:
+		Adjacency(const int* _p, int* _c, int _n):
+			p(_p), c(_c), n(_n){}
+
+		Iterator begin() const { return Iterator(p, c); }
+		Iterator end() const { return Iterator(p + n, c + n); }
+		size_t size() const { return (size_t)n; }
+		bool empty() const { return n == 0; }
+		EdgeRef operator [] (int k) const { return EdgeRef(p[k], c[k]); }
+	};
+
+	Adjacency operator [] (int i) {
+		int b = offset[i];
+		return Adjacency(pid.data() + b, ncmts.data() + b, offset[i + 1] - b);
+	}
+
+	Adjacency by_cmts(int i) {
+		int b = offset[i];
+		return Adjacency(cmts_pid.data() + b, cmts_ncmts.data() + b, offset[i + 1] - b);
+	}
+
+	void sort_by_cmts();
+
+	int size() const { return offset.empty() ? 0 : (int)offset.size() - 1; }
+	int degree(int i) const { return offset[i + 1] - offset[i]; }
+	size_t nr_edge() const { return pid.size(); }
+
+	void clear() {
+		FreeAll(offset);
+		FreeAll(pid);
+		FreeAll(ncmts);
+		FreeAll(cmts_pid);
+		FreeAll(cmts_ncmts);
+	}
+};
+
 typedef std::set<int> TagSet;
 // Data structure to store all the interest tag of a person
 // could be implemented as vector<bool> later
@@ -71,8 +152,8 @@ class Data {
 public:
 	static int nperson, ntag;
 
-	static std::vector<std::vector<ConnectedPerson> > friends;
-	// friends[i] is a vector(sorted by 'id') of friends of the person with id=i
+	static FriendGraph friends;
+	// friends[i] is the adjacency (sorted by 'id') of the person with id=i
 	static std::vector<unordered_set<int>> friends_hash;
 	// destroyed after read_comments
 
@@ -89,11 +170,20 @@ public:
 	static std::vector<std::string> tag_name;		// name of each tags, indexed by continuous id
 	// destroyed after q2 and read q4 finished!
 
+	static std::vector<int> tag_rank;		// rank of each tag_name in lexicographic order
+	// destroyed after q2 finished
+
 
 	// destroyed after q3 finished:
 	static unordered_map<std::string, std::vector<int>, StringHashFunc> placeid;
 	// id of each place. note that for a specific name, there might be several places
 	static std::vector<PlaceNode> places;			// each place indexed by id
+	static PlaceIndex place_index;		// persons under each place, built from places
+
+	// only in server mode, where none of the above is destroyed:
+	static std::vector<std::vector<int>> tag_forums;		// forums having each tag
+	static std::vector<std::vector<int>> forum_members;		// persons of each forum
+	static unordered_map<std::string, int, StringHashFunc> tagid;		// continuous id of each tag name
 
 #ifdef DEBUG
 	static std::vector<int> real_tag_id;		// continuous id -> real id
@@ -101,6 +191,15 @@ public:
 
 	static void allocate();
 	static void free();
+
+	// fill tag_rank from tag_name
+	static void rank_tag_name();
+
+	// keep the forums for server mode, and index tag_name by name.
+	// forum_tags[i]: continuous tag ids of the i-th forum, forum_members is
+	// swapped in
+	static void set_forums(const std::vector<std::vector<int>>& forum_tags,
+			std::vector<std::vector<int>>& members);
 private:
 	Data(){};
 
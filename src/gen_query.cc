@@ -112,8 +112,11 @@ int main(int argc, char* argv[]) {
 	}
 	fclose(fin);
 
-	read_data(dir);
-	read_tags_forums_places(dir);
+	read_person_file(dir);
+	read_person_knows_person(dir);
+	read_tags(dir);
+	read_places(dir);
+	read_forums(dir);
 	freopen(argv[2], "w", stdout);
 	for (int i = 3; i < 7; ++i)
 		num_q[i - 3] = atoi(argv[i]);
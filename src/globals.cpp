@@ -7,17 +7,7 @@
 
 using namespace std;
 
-#define DEFINE_SIGNAL(s) \
-	mutex s ## _mt; \
-	bool s = false; \
-	condition_variable s ## _cv;
-
 // global variables
-DEFINE_SIGNAL(tag_read)
-DEFINE_SIGNAL(friends_hash_built)
-DEFINE_SIGNAL(q2_finished)
-#undef DEFINE_SIGNAL
-
 Timer globaltimer;
 
 ThreadPool* threadpool;
@@ -26,6 +16,8 @@ vector<double> tot_time(5, 0.0);
 
 int q1_cmt_vst = 0;
 
+bool server_mode = false;
+
 unordered_set<string, StringHashFunc> q4_tag_set;
 unordered_map<string, vector<bool>> q4_persons;
 vector<thread> q4_jobs;
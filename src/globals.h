@@ -13,30 +13,18 @@
 #include "bread.h"
 // global variables!!
 
-#define WAIT_FOR(s) \
-	std::unique_lock<std::mutex> s ## lk(s ## _mt); \
-	while (!s) (s ## _cv).wait(s ## lk); \
-	s ## lk.unlock();
-
 extern Timer globaltimer;
 
-#define DECLARE_SIGNAL(s) \
-	extern std::condition_variable s ## _cv; \
-	extern std::mutex s ## _mt; \
-	extern bool s;
-
-DECLARE_SIGNAL(tag_read)
-DECLARE_SIGNAL(friends_hash_built)
-DECLARE_SIGNAL(q2_finished)
-
-#undef DECLARE_SIGNAL
-
 extern ThreadPool* threadpool;
 
 extern std::vector<double> tot_time;
 
 extern int q1_cmt_vst;
 
+// loaded once to answer queries arriving later: nothing is freed after use,
+// and Query 4 may ask any tag
+extern bool server_mode;
+
 extern unordered_set<std::string, StringHashFunc> q4_tag_set;
 extern unordered_map<std::string, std::vector<bool>> q4_persons;
 class Q4Scheduler;
@@ -0,0 +1,132 @@
+//File: graph_kernel.cpp
+//Date: Sat Oct 17 21:08:52 2026 +0000
+
+
+#include <algorithm>
+
+#include "graph_kernel.h"
+#include "data.h"
+#include "lib/common.h"
+#include "lib/utils.h"
+#include "lib/bfs_scratch.h"
+using namespace std;
+
+namespace {
+	// top-down -> bottom-up when frontier edges > unexplored edges / ALPHA,
+	// bottom-up -> top-down when frontier vertices < n / BETA
+	const long long ALPHA = 14, BETA = 24;
+
+	typedef unsigned long long mask_t;
+
+	// without a threshold every edge counts, and the id-sorted rows are
+	// already there before comments are read
+	inline FriendGraph::Adjacency adjacency(int v, int x) {
+		return x < 0 ? Data::friends[v] : Data::friends.by_cmts(v);
+	}
+
+	// one direction of a bidirectional search
+	struct BFSSide {
+		EpochVisited visited;
+		vector<int> dist;		// valid for visited vertices
+		vector<int> frontier, next;
+		vector<mask_t> in_frontier;		// bitmap of frontier, for bottom-up
+		long long frontier_edges, unexplored_edges;
+		bool bottom_up;
+		int depth;
+
+		BFSSide():
+			dist(Data::nperson),
+			in_frontier(((size_t)Data::nperson + 63) / 64, 0) {}
+
+		void start(int s) {
+			visited.clear(Data::nperson);
+			visited.set(s);
+			dist[s] = 0;
+			frontier.clear();
+			frontier.emplace_back(s);
+			frontier_edges = Data::friends.degree(s);
+			unexplored_edges = (long long)Data::friends.nr_edge() - frontier_edges;
+			bottom_up = false;
+			depth = 0;
+		}
+
+		void visit(int v, const BFSSide& other, int& best) {
+			visited.set(v);
+			dist[v] = depth;
+			next.emplace_back(v);
+			if (other.visited.test(v))
+				update_min(best, depth + other.dist[v]);
+		}
+
+		// expand one level, update best with paths meeting the other side
+		void expand(int x, const BFSSide& other, int& best) {
+			auto& g = Data::friends;
+			int n = Data::nperson;
+			if (not bottom_up and frontier_edges > unexplored_edges / ALPHA)
+				bottom_up = true;
+			else if (bottom_up and (long long)frontier.size() < n / BETA)
+				bottom_up = false;
+
+			depth ++;
+			next.clear();
+			if (not bottom_up) {
+				FOR_ITR(v, frontier) {
+					auto fs = adjacency(*v, x);
+					for (auto it = fs.begin(); it != fs.end(); it ++) {
+						if (it->ncmts <= x) break;		// sorted by ncmts
+						if (not visited.test(it->pid))
+							visit(it->pid, other, best);
+					}
+				}
+			} else {
+				FOR_ITR(v, frontier)
+					in_frontier[*v >> 6] |= 1ULL << (*v & 63);
+				REP(v, n) {
+					if (visited.test(v)) continue;
+					auto fs = adjacency(v, x);
+					for (auto it = fs.begin(); it != fs.end(); it ++) {
+						if (it->ncmts <= x) break;
+						int u = it->pid;
+						if (in_frontier[u >> 6] >> (u & 63) & 1) {
+							visit(v, other, best);
+							break;
+						}
+					}
+				}
+				FOR_ITR(v, frontier)
+					in_frontier[*v >> 6] = 0;
+			}
+			frontier.swap(next);
+
+			frontier_edges = 0;
+			FOR_ITR(v, frontier)
+				frontier_edges += g.degree(*v);
+			unexplored_edges -= frontier_edges;
+		}
+	};
+}
+
+struct BidirSides {
+	BFSSide side[2];
+};
+
+int bidir_bfs(int s, int t, int x, int max_depth) {
+	if (s == t) return 0;
+	BFSScratch& bs = BFSScratch::local();
+	if (not bs.bidir)
+		bs.bidir = make_shared<BidirSides>();
+	BFSSide &a = bs.bidir->side[0], &b = bs.bidir->side[1];
+	a.start(s); b.start(t);
+
+	int best = INT_MAX;
+	while (not a.frontier.empty() and not b.frontier.empty()
+			and a.depth + b.depth < max_depth) {
+		if (a.frontier_edges <= b.frontier_edges)
+			a.expand(x, b, best);
+		else
+			b.expand(x, a, best);
+		// every path of length <= a.depth + b.depth has been seen
+		if (best != INT_MAX) break;
+	}
+	return best != INT_MAX && best <= max_depth ? best : -1;
+}
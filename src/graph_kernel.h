@@ -0,0 +1,19 @@
+//File: graph_kernel.h
+//Date: Sat Oct 17 21:08:52 2026 +0000
+
+
+#pragma once
+#include <vector>
+#include <climits>
+
+// Searches on Data::friends shared by the queries.
+
+// Bidirectional BFS between s and t through edges with ncmts > x.
+// Each step expands the side with fewer frontier edges, level by level.
+// A side switches to bottom-up (every unvisited vertex looks for a parent
+// in the frontier bitmap) when its frontier covers a large share of the
+// remaining edges, and back to top-down when the frontier shrinks (Beamer,
+// "Direction-Optimizing Breadth-First Search", SC'12).
+//
+// return the distance, or -1 if there is no path of length <= max_depth
+int bidir_bfs(int s, int t, int x, int max_depth = INT_MAX);
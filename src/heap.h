@@ -1,46 +1,57 @@
 #include <vector>
+#include <cstdint>
 #include "lib/debugutils.h"
 using namespace std;
 
 struct HeapEle {
+	// larger range first, then smaller tag name: smaller key is better.
+	// high 32 bits: ~range, low 32 bits: Data::tag_rank
+	uint64_t key;
 	int range;      // defined in the problem
 	int tag_id;
 	HeapEle(int _range = -1, int _tag_id = -1)
-		:range(_range), tag_id(_tag_id) {}
+		:key(make_key(_range, _tag_id)), range(_range), tag_id(_tag_id) {}
 
     bool operator <(const HeapEle &b) const {
-		return (range > b.range) || ((range == b.range) && (Data::tag_name[tag_id] < Data::tag_name[b.tag_id]));
+		return key < b.key;
+	}
+
+	static uint64_t make_key(int range, int tag_id) {
+		uint32_t rank = tag_id < 0 ? 0U : (uint32_t)Data::tag_rank[tag_id];
+		return ((uint64_t)~(uint32_t)range << 32) | rank;
 	}
 };
 
+// 4-ary min heap of HeapEle, children of p are 4p+1 ... 4p+4
 class MyHeap {
 public:
-    MyHeap() :heap(1) {}
     void insert(int id, int key) {
         place[id] = (int) heap.size();
         heap.push_back(HeapEle(key, id));
         move_up((int) heap.size() -1);
     }
     HeapEle get() {
-        HeapEle ans = heap[1];
-        heap[1] = heap[heap.size() -1];
-        place[heap[1].tag_id] = 1;
+        HeapEle ans = heap[0];
+        heap[0] = heap.back();
+        place[heap[0].tag_id] = 0;
         heap.pop_back();
-        move_down(1);
+        if (not heap.empty()) move_down(0);
         return ans;
     }
+    // range of a tag never decreases
     void change(int id, int key) {
-        if (heap[place[id]].range >= key) return ;
-        heap[place[id]].range = key;
-        move_down(place[id]);
+        HeapEle& e = heap[place[id]];
+        if (e.range >= key) return ;
+        e = HeapEle(key, id);
         move_up(place[id]);
     }
     HeapEle top() {
-        if ((int) heap.size() == 1) return HeapEle(-1, -1);
-        return heap[1];
+        if (heap.empty()) return HeapEle(-1, -1);
+        return heap[0];
     }
+    int size() const { return (int) heap.size(); }
     void resize(int _n) {
-        place.resize(_n+1);
+        place.resize(_n);
     }
 
 	void free() {
@@ -52,30 +63,39 @@ private:
     vector<int> place;
     vector<HeapEle> heap;
 
-    void swap(int i, int j) {
-        HeapEle temp = heap[i]; heap[i] = heap[j]; heap[j] = temp;
-        place[heap[i].tag_id] = i;
-        place[heap[j].tag_id] = j;
-    }
     void move_down(int p) {
+        HeapEle now = heap[p];
+        int n = (int) heap.size();
         while (true) {
-            int p2 = p;
-            if ((p << 1) < (int) heap.size() && heap[p << 1] < heap[p2]) p2 = p << 1;
-            if ((p << 1)+1 < (int) heap.size() && heap[(p << 1)+1] < heap[p2]) p2 = (p << 1) + 1;
-            if (p == p2) break;
-            swap(p, p2);
-            p = p2;
+            int c = (p << 2) + 1;
+            if (c >= n) break;
+            int best = c;
+            int ce = min(c + 4, n);
+            for (c ++; c < ce; c ++)
+                if (heap[c].key < heap[best].key) best = c;
+            if (not (heap[best].key < now.key)) break;
+            heap[p] = heap[best];
+            place[heap[p].tag_id] = p;
+            p = best;
         }
+        heap[p] = now;
+        place[now.tag_id] = p;
     }
     void move_up(int p) {
-        while (p > 1 && heap[p] < heap[p>>1])  {
-            swap(p, p>>1);
-            p = p >> 1;
+        HeapEle now = heap[p];
+        while (p > 0) {
+            int parent = (p - 1) >> 2;
+            if (not (now.key < heap[parent].key)) break;
+            heap[p] = heap[parent];
+            place[heap[p].tag_id] = p;
+            p = parent;
         }
+        heap[p] = now;
+        place[now.tag_id] = p;
     }
     bool check() {
-        for (int i=2; i<(int) heap.size(); i++) {
-            if (heap[i] < heap[i >> 1]) return false;
+        for (int i=1; i<(int) heap.size(); i++) {
+            if (heap[i] < heap[(i - 1) >> 2]) return false;
             if (place[heap[i].tag_id] != i) {print_debug("Oh, no!\n");m_assert(0);return false;}
         }
         return true;
@@ -0,0 +1,95 @@
+//File: hop_ball.cpp
+//Date: Sat Oct 17 22:51:18 2026 +0000
+
+
+#include <algorithm>
+#include <list>
+#include <mutex>
+
+#include "hop_ball.h"
+#include "data.h"
+#include "graph_kernel.h"
+#include "lib/bfs_scratch.h"
+using namespace std;
+
+HopBalls::HopBalls(const shared_ptr<const vector<int>>& _people, int _h):
+	people(_people), h(_h), state(_people->size(), 0),
+	ball(_people->size()), nr_entry(_people->size() * 2) {}
+
+void HopBalls::build(int g) {
+	BFSScratch& bs = BFSScratch::local();
+	bs.start(Data::nperson);
+	auto& q = bs.queue;
+	int source = (*people)[g];
+	bs.visited.set(source);
+	q.push(source);
+	int nr_visit = 1;
+	vector<int> inside;
+	for (int depth = 0; depth < h and not q.empty(); depth ++) {
+		int qsize = (int)q.size();
+		REP(i, qsize) {
+			auto fr = Data::friends[q.pop()];
+			FOR_ITR(e, fr) {
+				if (not bs.visited.test_and_set(e->pid)) continue;
+				if (++ nr_visit > HOP_BALL_MAX_VISIT) {
+					state[g] = TOO_LARGE;
+					return;
+				}
+				q.push(e->pid);
+				if (binary_search(people->begin(), people->end(), e->pid))
+					inside.emplace_back(e->pid);
+			}
+		}
+	}
+	sort(inside.begin(), inside.end());
+	nr_entry += inside.size();
+	ball[g].swap(inside);
+	state[g] = BUILT;
+}
+
+bool HopBalls::within(int g, int pid) {
+	if (state[g] >= 0 and ++ state[g] > HOP_BALL_MIN_CHECK)
+		build(g);
+	if (state[g] == BUILT)
+		return binary_search(ball[g].begin(), ball[g].end(), pid);
+	return bidir_bfs((*people)[g], pid, -1, h) != -1;
+}
+
+namespace {
+	typedef pair<string, int> CacheKey;
+	typedef pair<CacheKey, shared_ptr<HopBalls>> CacheEntry;
+
+	mutex cache_mt;
+	list<CacheEntry> cache;		// most recently used first
+	size_t cache_size = 0;
+}
+
+shared_ptr<HopBalls> HopBallCache::get(const string& place, int h) {
+	lock_guard<mutex> lg(cache_mt);
+	CacheKey key(place, h);
+	FOR_ITR(itr, cache) if (itr->first == key) {
+		shared_ptr<HopBalls> ret = itr->second;
+		cache_size -= ret->memory();
+		cache.erase(itr);
+		return ret;
+	}
+	return shared_ptr<HopBalls>();
+}
+
+void HopBallCache::put(const string& place, int h,
+		const shared_ptr<HopBalls>& balls) {
+	if (balls->memory() > HOP_BALL_CACHE_SIZE) return;
+	lock_guard<mutex> lg(cache_mt);
+	cache.emplace_front(CacheKey(place, h), balls);
+	cache_size += balls->memory();
+	while (cache_size > HOP_BALL_CACHE_SIZE) {
+		cache_size -= cache.back().second->memory();
+		cache.pop_back();
+	}
+}
+
+void HopBallCache::clear() {
+	lock_guard<mutex> lg(cache_mt);
+	cache.clear();
+	cache_size = 0;
+}
@@ -0,0 +1,58 @@
+//File: hop_ball.h
+//Date: Sat Oct 17 22:51:18 2026 +0000
+
+
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+
+// h-hop neighborhoods ("balls") of the people of one Query 3 place.
+// Once a person has been checked HOP_BALL_MIN_CHECK times, its ball is
+// computed by one bounded BFS and kept as a sorted array of the people
+// inside it, so every later check of that person is a binary search
+// instead of a pairwise BFS.
+// Checks before that, and of balls that would visit too much of the
+// graph, use bidir_bfs.
+class HopBalls {
+	public:
+		// people: sorted pids of the place
+		HopBalls(const std::shared_ptr<const std::vector<int>>& people, int h);
+
+		// whether dist(people[g], pid) <= h.
+		// calls with different g may run concurrently
+		bool within(int g, int pid);
+
+		// number of ints kept
+		size_t memory() const { return nr_entry; }
+
+	private:
+		// number of checks done so far, or one of the states below
+		enum State { BUILT = -1, TOO_LARGE = -2 };
+
+		std::shared_ptr<const std::vector<int>> people;
+		int h;
+		std::vector<char> state;
+		std::vector<std::vector<int>> ball;
+		std::atomic<size_t> nr_entry;
+
+		void build(int g);
+};
+
+// least recently used HopBalls of (place, h), shared by later queries.
+// get() takes the entry out, so a query owns it until put() back
+class HopBallCache {
+	public:
+		static std::shared_ptr<HopBalls> get(const std::string& place, int h);
+		static void put(const std::string& place, int h,
+				const std::shared_ptr<HopBalls>& balls);
+		static void clear();
+};
+
+// checks of a person answered by bidir_bfs before building its ball
+const int HOP_BALL_MIN_CHECK = 4;
+// a ball visiting more persons than this is not kept
+const int HOP_BALL_MAX_VISIT = 1 << 12;
+// total ints kept by HopBallCache
+const size_t HOP_BALL_CACHE_SIZE = 1 << 22;
@@ -33,30 +33,21 @@ extern std::vector<Query4> q4_set;
 
 
 
-inline int do_read_comments(const std::string dir) {
+inline void do_read_comments(const std::string dir) {
 	Timer timer;
-	read_comments_tim(dir);
+	read_comment_replies(dir);
 	if (Data::nperson > 11000)
 		fprintf(stderr, "r cmt: %.4lf\n", timer.get_time());
 	fflush(stderr);
-	return 0;
-}
-inline int do_read_tags_forums_places(const std::string dir) {
-	Timer timer;
-	read_tags_forums_places(dir);
-//	if (Data::nperson > 11000)
-//		fprintf(stderr, "npl:%lu, forut:%.4lf\n", Data::placeid.size(), timer.get_time());
-	return 0;
 }
 
 
-inline void start_1(int) {
+inline void start_1() {
 	PP("start1");
 	Timer timer;
 //	q1.pre_work();		// sort Data::frien
 	q1.continuation = std::make_shared<FinishTimeContinuation>(q1_set.size(), "q1 finish time");
-	REP(i, q1_set.size())
-		q1.add_query(q1_set[i], (int)i);
+	q1.add_queries(q1_set);
 	tot_time[1] += timer.get_time();
 	PP(q1_cmt_vst);
 }
@@ -73,15 +64,17 @@ inline void start_3() {
 	Timer timer;
 	size_t s = q3_set.size();
 	q3.continuation = std::make_shared<FinishTimeContinuation>(s, "q3 finish time");
+	TaskGroup group(threadpool, 5);
 	REP(i, s) {
 		//q3.add_query(q3_set[i].k, q3_set[i].hop, q3_set[i].place, i);
 		//print_debug("finish q3 %lu at %lf\n", i, timer.get_time());
-		threadpool->enqueue(bind(&Query3Handler::add_query, &q3, q3_set[i].k, q3_set[i].hop, q3_set[i].place, i));
+		group.run(bind(&Query3Handler::add_query, &q3, q3_set[i].k, q3_set[i].hop, q3_set[i].place, i));
 	}
+	group.wait();
 	q3_set = std::vector<Query3>();
 }
 
-inline void start_4(int) {
+inline void start_4() {
 	fprintf(stderr, "start4\n");
 	//std::this_thread::sleep_for(std::chrono::seconds(7));
 	Timer timer;
@@ -89,31 +82,28 @@ inline void start_4(int) {
 	q4.continuation = std::make_shared<FinishTimeContinuation>(s, "q4 finish time");
 	/*
 	 *if (Data::nperson > 300000) {
+	 *        q4.prepare_tags(q4_set);
 	 *        q4_sched = new Q4Scheduler(4);
 	 *        q4_sched->work();
 	 *} else {
 	 */
-			REP(i, s) {
-					threadpool->enqueue(bind(&Query4Handler::add_query,
-											&q4, q4_set[i].k, q4_set[i].tag, i), 10);
-			}
+			q4.add_queries(q4_set);
 	/*
 	 *}
 	 */
 }
 
-// call after read forum
+// after q2 and the forums, which look tags up by name
 void destroy_tag_name() {
-		WAIT_FOR(q2_finished);
 		FreeAll(Data::tag_name);
 }
 
-// call after all q3 finished
+// after q2 and q3
 void destroy_q3_data() {
+		Query3Handler::free_index();
 		Data::placeid.clear();
 		Data::placeid = unordered_map<std::string, std::vector<int>, StringHashFunc>();
 		FreeAll(Data::places);
-		WAIT_FOR(q2_finished);
 		FreeAll(Data::tags);
 }
 
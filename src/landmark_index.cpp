@@ -0,0 +1,179 @@
+//File: landmark_index.cpp
+//Date: Sat Oct 17 20:41:09 2026 +0000
+
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+
+#include "landmark_index.h"
+#include "data.h"
+#include "lib/common.h"
+#include "lib/utils.h"
+#include "lib/bfs_scratch.h"
+using namespace std;
+
+namespace {
+	const int INF = 1e9;
+	const int MAX_DIST = 255;
+	// roots searched together. batches start at NUM_THREADS roots, and grow
+	// as the searches get pruned early
+	const int MAX_BATCH = 256;
+
+	struct DegreeCmp {
+		const vector<int>& degree;
+		DegreeCmp(const vector<int>& _degree):
+			degree(_degree) {}
+		bool operator () (int a, int b) const
+		{ return degree[a] > degree[b]; }
+	};
+
+	// The roots of a batch run their pruned BFS in parallel, each pruned by
+	// the labels of the batches before only. Labels found inside a batch
+	// may be redundant, never wrong, so queries stay exact.
+	struct LabelBuilder {
+		int x;
+		size_t max_entry;
+		const vector<int>& order;
+		// hubs are appended in rank order, so every label list stays sorted
+		vector<vector<int>> l_hub;
+		vector<vector<unsigned char>> l_dist;
+
+		int first;		// rank of the first root of the batch
+		vector<vector<pair<int, int>>> found;		// (vertex, dist) of each root
+		atomic<size_t> nr_entry;
+		atomic<bool> failed;
+
+		LabelBuilder(int _x, size_t _max_entry, const vector<int>& _order):
+			x(_x), max_entry(_max_entry), order(_order),
+			l_hub(_order.size()), l_dist(_order.size()),
+			first(0), nr_entry(0), failed(false) {}
+
+		void search(int i);
+		void add_labels(int nr_root);
+	};
+
+	void LabelBuilder::search(int i) {
+		int rank = first + i, root = order[rank];
+		auto& out = found[i];
+		out.clear();
+		int n = (int)order.size();
+		auto& g = Data::friends;
+		BFSScratch& bs = BFSScratch::local();
+		bs.start(n);
+		bs.reserve_mark(n);
+		int* root_dist = bs.mark.data();		// labels of the root, by hub rank
+		const vector<vector<int>>& hubs = l_hub;
+		const vector<vector<unsigned char>>& dists = l_dist;
+		REP(k, hubs[root].size())
+			root_dist[hubs[root][k]] = dists[root][k];
+
+		bs.visited.set(root);
+		bs.queue.push(root);
+		for (int depth = 0; not bs.queue.empty(); depth ++) {
+			if (depth > MAX_DIST or nr_entry + out.size() > max_entry or failed) {
+				failed = true;
+				break;
+			}
+			int qsize = (int)bs.queue.size();
+			REP(j, qsize) {
+				int v = bs.queue.pop();
+				// pruned if earlier hubs already give a path this short
+				const int* h = hubs[v].data();
+				const unsigned char* d = dists[v].data();
+				int nr_label = (int)hubs[v].size();
+				bool pruned = false;
+				for (int k = 0; k < nr_label; k ++) {
+					if (root_dist[h[k]] + d[k] <= depth) {
+						pruned = true;
+						break;
+					}
+				}
+				if (pruned) continue;
+				out.emplace_back(v, depth);
+
+				auto fs = g.by_cmts(v);
+				for (auto it = fs.begin(); it != fs.end(); ++ it) {
+					if (it->ncmts <= x) break;		// sorted by ncmts
+					if (bs.visited.test_and_set(it->pid))
+						bs.queue.push(it->pid);
+				}
+			}
+		}
+
+		nr_entry += out.size();
+		FOR_ITR(itr, hubs[root]) root_dist[*itr] = MARK_INF;
+	}
+
+	void LabelBuilder::add_labels(int nr_root) {
+		REP(i, nr_root) {
+			int rank = first + i;
+			FOR_ITR(itr, found[i]) {
+				l_hub[itr->first].emplace_back(rank);
+				l_dist[itr->first].emplace_back((unsigned char)itr->second);
+			}
+		}
+	}
+}
+
+bool LandmarkIndex::build(int x, size_t max_entry) {
+	int n = Data::nperson;
+	auto& g = Data::friends;
+
+	// hubs by degree in the thresholded graph, higher first
+	vector<int> order(n), degree(n, 0);
+	REP(i, n) {
+		order[i] = i;
+		auto fs = g.by_cmts(i);
+		for (auto it = fs.begin(); it != fs.end() and it->ncmts > x; ++ it)
+			degree[i] ++;
+	}
+	stable_sort(order.begin(), order.end(), DegreeCmp(degree));
+
+	LabelBuilder lb(x, max_entry, order);
+	lb.found.resize(MAX_BATCH);
+	while (lb.first < n) {
+		int nr_root = min(max(NUM_THREADS, lb.first / 16), MAX_BATCH);
+		nr_root = min(nr_root, n - lb.first);
+		threadpool->parallel_for(0, nr_root,
+				bind(&LabelBuilder::search, &lb, placeholders::_1), 1);
+		if (lb.failed)
+			return false;
+		lb.add_labels(nr_root);
+		lb.first += nr_root;
+	}
+	FreeAll(lb.found);
+
+	auto& l_hub = lb.l_hub;
+	auto& l_dist = lb.l_dist;
+	offset.assign(n + 1, 0);
+	REP(i, n) offset[i + 1] = offset[i] + l_hub[i].size();
+	hub.reserve(offset[n]);
+	dist.reserve(offset[n]);
+	REP(i, n) {
+		hub.insert(hub.end(), l_hub[i].begin(), l_hub[i].end());
+		dist.insert(dist.end(), l_dist[i].begin(), l_dist[i].end());
+		FreeAll(l_hub[i]); FreeAll(l_dist[i]);
+	}
+	return true;
+}
+
+int LandmarkIndex::query(int p1, int p2) const {
+	size_t i = offset[p1], ie = offset[p1 + 1];
+	size_t j = offset[p2], je = offset[p2 + 1];
+	int ret = INF;
+	while (i < ie and j < je) {
+		if (hub[i] == hub[j]) {
+			update_min(ret, (int)dist[i] + (int)dist[j]);
+			i ++, j ++;
+		} else if (hub[i] < hub[j])
+			i ++;
+		else
+			j ++;
+	}
+	return ret == INF ? -1 : ret;
+}
+
+size_t LandmarkIndex::memory() const {
+	return offset.size() * sizeof(size_t) + hub.size() * sizeof(int) + dist.size();
+}
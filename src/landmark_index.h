@@ -0,0 +1,31 @@
+//File: landmark_index.h
+//Date: Sat Oct 17 20:41:09 2026 +0000
+
+
+#pragma once
+#include <vector>
+#include <cstddef>
+
+// Pruned landmark labeling (Akiba et al., SIGMOD'13) on the graph of
+// edges with ncmts > x: every person keeps a list of (hub, distance), and
+// dist(p1, p2) is the minimum over common hubs, so a query is one merge.
+//
+// Hubs are tried in degree order; a BFS from a hub is pruned at vertices
+// whose distance is already covered by earlier labels.
+class LandmarkIndex {
+	public:
+		// return false (and keep nothing) if the labels would need more than
+		// max_entry entries in total
+		bool build(int x, size_t max_entry);
+
+		// -1 if unreachable
+		int query(int p1, int p2) const;
+
+		size_t memory() const;		// bytes
+
+	private:
+		// labels of p are [offset[p], offset[p + 1]) of hub/dist, sorted by hub
+		std::vector<size_t> offset;
+		std::vector<int> hub;		// rank of the hub
+		std::vector<unsigned char> dist;
+};
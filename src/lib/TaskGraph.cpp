@@ -0,0 +1,86 @@
+//File: TaskGraph.cpp
+//Date: Sun Oct 18 02:10:26 2026 +0000
+
+
+#include "TaskGraph.hh"
+#include "debugutils.h"
+using namespace std;
+
+int TaskGraph::add(const string& name, function<void()> f,
+		const vector<int>& deps, int priority) {
+	Stage s;
+	s.name = name;
+	s.f = move(f);
+	s.priority = priority;
+	s.nr_wait = (int)deps.size();
+	s.last_input = -1;
+	s.ready = s.start = s.finish = 0;
+	int id = (int)stages.size();
+	for (auto itr = deps.begin(); itr != deps.end(); ++itr) {
+		m_assert(*itr >= 0 && *itr < id);
+		stages[*itr].next.emplace_back(id);
+	}
+	stages.emplace_back(move(s));
+	return id;
+}
+
+void TaskGraph::launch(int id) {
+	tp->enqueue(bind(run_stage, this, id), stages[id].priority);
+}
+
+void TaskGraph::run_stage(TaskGraph* g, int id) {
+	Stage& s = g->stages[id];
+	s.start = g->timer.get_time();
+	if (s.f) s.f();
+	s.f = nullptr;		// release what it holds
+
+	lock_guard<mutex> lock(g->mt);
+	s.finish = g->timer.get_time();
+	for (auto itr = s.next.begin(); itr != s.next.end(); ++itr) {
+		Stage& n = g->stages[*itr];
+		if (-- n.nr_wait > 0) continue;
+		n.ready = s.finish;
+		n.last_input = id;
+		g->launch(*itr);
+	}
+	if (-- g->nr_left == 0)
+		g->all_done.notify_all();
+}
+
+void TaskGraph::run() {
+	timer.reset();
+	{
+		lock_guard<mutex> lock(mt);
+		nr_left = (int)stages.size();
+		for (int i = 0; i < (int)stages.size(); i ++)
+			if (stages[i].nr_wait == 0)
+				launch(i);
+	}
+	// the workers run the stages and whatever they spread over the pool
+	unique_lock<mutex> lock(mt);
+	while (nr_left > 0)
+		all_done.wait(lock);
+}
+
+void TaskGraph::print_critical_path() {
+	lock_guard<mutex> lock(mt);
+	m_assert(nr_left == 0);
+	int last = -1;
+	for (int i = 0; i < (int)stages.size(); i ++)
+		if (last == -1 || stages[i].finish > stages[last].finish)
+			last = i;
+	vector<int> path;
+	for (int i = last; i != -1; i = stages[i].last_input)
+		path.emplace_back(i);
+
+	// name wait+run for each stage: wait is the time spent queued
+	fprintf(stderr, "critical path:");
+	for (auto itr = path.rbegin(); itr != path.rend(); ++itr) {
+		const Stage& s = stages[*itr];
+		fprintf(stderr, " %s %.4lf+%.4lf", s.name.c_str(),
+				s.start - s.ready, s.finish - s.start);
+	}
+	if (last != -1)
+		fprintf(stderr, " = %.4lf secs\n", stages[last].finish);
+	fflush(stderr);
+}
@@ -0,0 +1,57 @@
+//File: TaskGraph.hh
+//Date: Sun Oct 18 02:10:26 2026 +0000
+
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "ThreadPool.hh"
+#include "Timer.h"
+
+// Stages of one run and the stages each of them needs.
+// A stage is enqueued on the pool as soon as all of its inputs are done,
+// and is done when its function returns: a stage spreading work over the
+// pool waits for it (TaskGroup) before returning.
+// Loading, query and cleanup stages are all declared here, so the order
+// of a run is the graph, and its critical path can be printed at the end.
+class TaskGraph {
+	public:
+		TaskGraph(ThreadPool* _tp): tp(_tp), nr_left(0) {}
+
+		// return the id of the new stage. f may be empty, for a barrier
+		int add(const std::string& name, std::function<void()> f,
+				const std::vector<int>& deps = std::vector<int>(), int priority = 5);
+
+		// run all stages on the pool workers, the calling thread sleeps.
+		// return once all stages are done
+		void run();
+
+		// chain of stages, each started by the one before, that ended last
+		void print_critical_path();
+
+	private:
+		struct Stage {
+			std::string name;
+			std::function<void()> f;
+			int priority;
+			std::vector<int> next;
+			int nr_wait;		// inputs not done yet
+			int last_input;		// the input done last, -1 if none
+			double ready, start, finish;		// secs since run()
+		};
+
+		ThreadPool* tp;
+		Timer timer;
+		std::vector<Stage> stages;
+
+		std::mutex mt;
+		std::condition_variable all_done;
+		int nr_left;
+
+		static void run_stage(TaskGraph* g, int id);
+		void launch(int id);
+};
@@ -5,51 +5,205 @@
 #include "ThreadPool.hh"
 #include "Timer.h"
 #include "debugutils.h"
+using namespace std;
+using namespace __ThreadPoolImpl;
+
+namespace {
+	// the pool and the index of the calling thread, if it is a worker
+	__thread ThreadPool* cur_pool = NULL;
+	__thread int cur_id = -1;
+
+	// loop shared by parallel_for and its helpers
+	struct ForState {
+		atomic<int> next;
+		int busy;		// threads that may still run body, under mt
+		mutex mt;
+		condition_variable done;		// signaled when busy drops to 0
+		int end, grain;
+		function<void(int)> body;
+
+		ForState(int begin, int _end, int _grain, const function<void(int)>& _body):
+			next(begin), busy(0), end(_end), grain(_grain), body(_body) {}
+	};
+
+	void run_chunks(shared_ptr<ForState> st) {
+		{
+			lock_guard<mutex> lock(st->mt);
+			st->busy ++;
+		}
+		for (int b; (b = st->next.fetch_add(st->grain)) < st->end; ) {
+			int e = min(b + st->grain, st->end);
+			for (int i = b; i < e; i ++)
+				st->body(i);
+		}
+		lock_guard<mutex> lock(st->mt);
+		if (-- st->busy == 0)
+			st->done.notify_all();
+	}
+}
 
 namespace __ThreadPoolImpl
 {
-	void worker(ThreadPool *tp) {
+	void worker(ThreadPool *tp, int id) {
+		cur_pool = tp;
+		cur_id = id;
+		Task task;
 		for (; ;) {
-			std::unique_lock<std::mutex> lock(tp->queue_mutex);
-			if (tp->stop && tp->nr_active_thread == 0 && tp->tasks.empty())
-				return;
-			while (tp->tasks.empty()) {
-				Timer wttt;
-				//	fprintf(stderr, "waiting %lu\n", tp->tasks.size());
-				tp->condition.wait(lock);
-				//	fprintf(stderr, "after waiting\n");
-				if (tp->stop && tp->nr_active_thread == 0 && tp->tasks.empty())
-					return;
-                print_debug("thread got a job after waiting for %.4lf secs\n", wttt.get_time());
+			tp->nr_active_thread ++;
+			if (tp->take(task)) {
+				task();
+				task = nullptr;
+				tp->on_task_done();
+				continue;
 			}
+			tp->on_task_done();
 
-			m_assert(tp->tasks.size());
-
-			std::function<void()> task(tp->tasks.top().second);
-			tp->tasks.pop();
-
-			lock.unlock();
-
-			/*
-			 *{			// old one
-			 *    std::lock_guard<std::mutex> lock(tp->nr_active_thread_mutex);
-			 *    tp->nr_active_thread ++;
-			 *    //	fprintf(stderr, "++: %d, q:%d\n", tp->nr_active_thread, (int)tp->tasks.size());
-			 *}
-			 */
-			__sync_fetch_and_add(&(tp->nr_active_thread), 1);
-			task();
-			{
-				//	std::lock_guard<std::mutex> lock_queue(tp->queue_mutex);
-				std::lock_guard<std::mutex> lock(tp->nr_active_thread_mutex);
-				tp->nr_active_thread --;
-				//	fprintf(stderr, "--: %d, q:%d\n", tp->nr_active_thread, (int)tp->tasks.size());
-				if (tp->stop && tp->nr_active_thread == 0 && tp->tasks.empty()) {
-					//		fprintf(stderr, "notify\n");
+			std::unique_lock<std::mutex> lock(tp->idle_mutex);
+			if (tp->nr_pending > 0) {
+				// queued but not visible yet, or just taken by another one
+				lock.unlock();
+				this_thread::yield();
+				continue;
+			}
+			Timer wttt;
+			while (tp->nr_pending == 0) {
+				if (tp->stop && tp->nr_active_thread == 0) {
 					tp->condition.notify_all();
 					return;
 				}
+				tp->condition.wait(lock);
 			}
+			print_debug("thread got a job after waiting for %.4lf secs\n", wttt.get_time());
+		}
+	}
+}
+
+// the constructor just launches some amount of workers
+ThreadPool::ThreadPool(size_t threads)
+	: local(new TaskDeque[MAX_WORKER * NR_PRIORITY_CLASS]),
+	nr_worker(0), nr_pending(0), nr_active_thread(0), stop(false)
+{
+	add_worker((int)threads);
+}
+
+// the destructor waits for all tasks, then joins all threads
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		stop = true;
+	}
+	condition.notify_all();
+	for(size_t i = 0;i<workers.size();++i)
+		workers[i].join();
+}
+
+void ThreadPool::add_worker(int k) {
+	m_assert(nr_worker + k <= MAX_WORKER);
+	for (int i = 0; i < k; i ++) {
+		workers.emplace_back(__ThreadPoolImpl::worker, this, (int)nr_worker);
+		nr_worker ++;
+	}
+}
+
+void ThreadPool::push(Task&& task, int priority) {
+	int c = priority_class(priority);
+	if (cur_pool == this)
+		local[cur_id * NR_PRIORITY_CLASS + c].push(std::move(task));
+	else
+		global[c].push(std::move(task));
+	nr_pending ++;
+	{
+		// a worker checks nr_pending under this lock before it sleeps
+		std::lock_guard<std::mutex> lock(idle_mutex);
+	}
+	condition.notify_one();
+}
+
+bool ThreadPool::take(Task& task) {
+	int id = cur_pool == this ? cur_id : -1;
+	int n = nr_worker;
+	for (int c = 0; c < NR_PRIORITY_CLASS; c ++) {
+		bool found = (id != -1 && local[id * NR_PRIORITY_CLASS + c].pop_back(task)) ||
+			global[c].pop_front(task);
+		for (int i = 1; i <= n && not found; i ++) {
+			int w = (id + i) % n;
+			if (w < 0) w += n;
+			if (w != id)
+				found = local[w * NR_PRIORITY_CLASS + c].pop_front(task);
+		}
+		if (found) {
+			nr_pending --;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::on_task_done() {
+	if (-- nr_active_thread > 0)
+		return;
+	std::lock_guard<std::mutex> lock(idle_mutex);
+	if (stop)
+		condition.notify_all();
+}
+
+void ThreadPool::parallel_for(int begin, int end,
+		const function<void(int)>& body, int grain) {
+	if (begin >= end)
+		return;
+	m_assert(grain > 0);
+	auto st = make_shared<ForState>(begin, end, grain, body);
+	int nr_chunk = (end - begin + grain - 1) / grain;
+	int nr_helper = min(get_nr_idle_thread(), nr_chunk - 1);
+	for (int i = 0; i < nr_helper; i ++)
+		enqueue(bind(run_chunks, st), 20);
+	run_chunks(st);
+	// helpers starting after this see no chunk left, and never touch body
+	unique_lock<mutex> lock(st->mt);
+	while (st->busy > 0)
+		st->done.wait(lock);
+}
+
+TaskGroup::TaskGroup(ThreadPool* _tp, int _priority):
+	tp(_tp), priority(_priority), st(make_shared<State>()) {}
+
+void TaskGroup::run(function<void()> f) {
+	{
+		lock_guard<mutex> lock(st->mt);
+		st->tasks.emplace_back(move(f));
+		st->nr_left ++;
+	}
+	tp->enqueue(bind(run_next, st), priority);
+}
+
+void TaskGroup::run_next(shared_ptr<State> st) {
+	function<void()> f;
+	{
+		lock_guard<mutex> lock(st->mt);
+		if (st->tasks.empty())		// run by wait()
+			return;
+		f = move(st->tasks.front());
+		st->tasks.pop_front();
+	}
+	f();
+	lock_guard<mutex> lock(st->mt);
+	if (-- st->nr_left == 0)
+		st->done.notify_all();
+}
+
+void TaskGroup::wait() {
+	// only children of this group run here, so a parent never ends up
+	// waiting behind an unrelated long task
+	for (; ;) {
+		{
+			lock_guard<mutex> lock(st->mt);
+			if (st->tasks.empty())
+				break;
 		}
+		run_next(st);
 	}
+	unique_lock<mutex> lock(st->mt);
+	while (st->nr_left > 0)
+		st->done.wait(lock);
 }
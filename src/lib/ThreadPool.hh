@@ -5,149 +5,178 @@
  */
 
 /**
- * A ``thread pool'' implementation for g++ 4.4 using callback
+ * A work-stealing thread pool.
+ *
+ * Every worker owns one deque per priority class: it runs the newest task
+ * of its own deque, and when that is empty takes the oldest task queued by
+ * other threads or steals the oldest one of another worker. Tasks of a
+ * higher class always run first.
+ * Tasks may spawn child tasks and wait for them (TaskGroup), or split a
+ * loop over the idle workers (parallel_for), without starting threads of
+ * their own.
  */
 
 #pragma once
 
 #include <vector>
-#include <queue>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <utility>
+#include <type_traits>
 #include <condition_variable>
 #include <functional>
-#include <stdexcept>
 #include "debugutils.h"
 
-struct TaskCmp {
-	bool operator() (const std::pair<int, std::function<void()>>& p1,
-			const std::pair<int, std::function<void()>>& p2) {
-		return p1.first < p2.first;
+class ThreadPool;
+namespace __ThreadPoolImpl {
+	typedef std::function<void()> Task;
+
+	// priority >= 20: first class, >= 10: second, >= 0: third.
+	// a negative one is background work, run when nothing else is queued
+	const int NR_PRIORITY_CLASS = 4;
+	inline int priority_class(int priority) {
+		if (priority < 0) return 3;
+		return priority >= 20 ? 0 : (priority >= 10 ? 1 : 2);
 	}
-};
 
+	const int MAX_WORKER = 64;
 
-class ThreadPool;
-namespace __ThreadPoolImpl {
-	class runner_base {
+	// the owner works at the back, the others take from the front
+	class TaskDeque {
 		public:
-			virtual void run() = 0;
+			void push(Task&& t) {
+				std::lock_guard<std::mutex> lock(mt);
+				q.emplace_back(std::move(t));
+			}
+			bool pop_back(Task& t) {
+				std::lock_guard<std::mutex> lock(mt);
+				if (q.empty()) return false;
+				t = std::move(q.back());
+				q.pop_back();
+				return true;
+			}
+			bool pop_front(Task& t) {
+				std::lock_guard<std::mutex> lock(mt);
+				if (q.empty()) return false;
+				t = std::move(q.front());
+				q.pop_front();
+				return true;
+			}
+
+		private:
+			std::mutex mt;
+			std::deque<Task> q;
 	};
 
+	// call f, pass its result to callback. both are kept by value
 	template<class Function, class Callback>
-	class runner : public runner_base {
+	class runner {
 		public:
-			Function &&f;
-			Callback &&callback;
+			Function f;
+			Callback callback;
 
-			runner(Function &&f, Callback &&callback) :
-				f(std::forward<Function>(f)), callback(std::forward<Callback>(callback))
+			runner(Function _f, Callback _callback) :
+				f(std::move(_f)), callback(std::move(_callback))
 			{ }
 
-			virtual void run() {
+			void operator () () {
 				callback(f());
 			}
 	};
 
-	inline void runner_wrapper(std::shared_ptr<runner_base> rn) {
-		rn->run();
-	}
-
-	void worker(ThreadPool *tp);
-	inline void task_wrapper(std::shared_ptr<std::function<void()>> func) {
-		(*func)();
-	}
+	void worker(ThreadPool *tp, int id);
 }
 
 class ThreadPool {
-private:
-
 public:
 	ThreadPool(size_t);
 	template<class Function, class Callback>
 		void enqueue(Function &&f, Callback &&callback, int priority = 5) {
-
-			auto task = std::make_shared<std::function<void()>>(
-					std::bind(__ThreadPoolImpl::runner_wrapper,
-						std::make_shared<__ThreadPoolImpl::runner<Function, Callback>>(
-							std::forward<Function>(f), std::forward<Callback>(callback))));
-			//auto task = std::make_shared<std::function<void()>>(std::bind(std::forward<Callback>(callback), (std::forward<Function>(f))()));
-			{
-				std::lock_guard<std::mutex> lock(queue_mutex);
-				tasks.emplace(priority, std::bind(__ThreadPoolImpl::task_wrapper, task));
-
-			}
-			condition.notify_one();
+			typedef __ThreadPoolImpl::runner<
+				typename std::decay<Function>::type,
+				typename std::decay<Callback>::type> runner_t;
+			push(__ThreadPoolImpl::Task(runner_t(
+							std::forward<Function>(f), std::forward<Callback>(callback))),
+					priority);
 		}
 
 	template<class Function>
 		void enqueue(Function &&f, int priority = 5) {
-
-			auto task = std::make_shared<std::function<void()>>(std::forward<Function>(f));
-			{
-				std::lock_guard<std::mutex> lock(queue_mutex);
-				tasks.emplace(priority, std::bind(__ThreadPoolImpl::task_wrapper, task));
-			}
-			condition.notify_one();
+			push(__ThreadPoolImpl::Task(std::forward<Function>(f)), priority);
 		}
 
+	// body(i) for all begin <= i < end, in chunks of grain indices shared
+	// by the calling thread and idle workers. return when all are done
+	void parallel_for(int begin, int end, const std::function<void(int)>& body,
+			int grain = 16);
+
 	~ThreadPool();
 
 	int get_nr_active_thread() const { return nr_active_thread; }
 
 	int get_nr_idle_thread() const {
-		return (int)workers.size() - nr_active_thread;
+		return nr_worker - nr_active_thread;
 	}
 
-	void add_worker(int k) {
-		for (int i = 0; i < k; i ++)
-			workers.emplace_back(std::bind(__ThreadPoolImpl::worker, this));
-	}
+	void add_worker(int k);
 
-	// the task queue
-	std::priority_queue<std::pair<int, std::function<void()>>,
-		std::vector<std::pair<int, std::function<void()>>>,
-			TaskCmp> tasks;
 	std::condition_variable condition;
 private:
-	friend void __ThreadPoolImpl::worker(ThreadPool *tp);
+	friend void __ThreadPoolImpl::worker(ThreadPool *tp, int id);
+
+	void push(__ThreadPoolImpl::Task&& task, int priority);
+	bool take(__ThreadPoolImpl::Task& task);
+	void on_task_done();
 
 	// need to keep track of threads so we can join them
 	std::vector<std::thread> workers;
 
+	// local[w * NR_PRIORITY_CLASS + c]: deque of worker w for class c
+	std::unique_ptr<__ThreadPoolImpl::TaskDeque[]> local;
+	// tasks queued by threads not in the pool
+	__ThreadPoolImpl::TaskDeque global[__ThreadPoolImpl::NR_PRIORITY_CLASS];
+
 	// synchronization
-	std::mutex queue_mutex;
-	std::mutex nr_active_thread_mutex;
+	std::mutex idle_mutex;
 
-	int nr_active_thread;
+	std::atomic<int> nr_worker;
+	std::atomic<int> nr_pending;		// queued, not taken yet
+	std::atomic<int> nr_active_thread;
 	bool stop;
 };
 
-// the constructor just launches some amount of workers
-inline ThreadPool::ThreadPool(size_t threads)
-	: nr_active_thread(0), stop(false)
-{
-	for(size_t i = 0;i < threads; ++ i)
-		workers.emplace_back(std::bind(__ThreadPoolImpl::worker, this));
-}
-
-
-// the destructor joins all threads
-inline ThreadPool::~ThreadPool()
-{
-	{
-		std::lock_guard<std::mutex> lock(queue_mutex);
-		stop = true;
-	}
-	//condition.notify_all();
-	for(size_t i = 0;i<workers.size();++i)
-		workers[i].join();
-}
+// Children of one parent task. wait() runs the children not started yet
+// on the calling thread, then blocks until the others are done.
+class TaskGroup {
+	public:
+		TaskGroup(ThreadPool* _tp, int _priority = 20);
+		~TaskGroup() { wait(); }
+
+		void run(std::function<void()> f);
+		void wait();
+
+	private:
+		struct State {
+			std::mutex mt;
+			std::condition_variable done;
+			std::deque<std::function<void()>> tasks;
+			int nr_left;		// not finished
+			State(): nr_left(0) {}
+		};
+
+		ThreadPool* tp;
+		int priority;
+		std::shared_ptr<State> st;
+
+		static void run_next(std::shared_ptr<State> st);
+
+		TaskGroup(const TaskGroup&);
+		TaskGroup& operator = (const TaskGroup&);
+};
 
-namespace __ThreadPoolImpl
-{ void worker(ThreadPool *tp); }
 /*
  * vim: syntax=cpp11.doxygen foldmethod=marker
  */
@@ -0,0 +1,62 @@
+//File: arena.h
+//Date: Sun Oct 18 00:12:44 2026 +0000
+
+
+#pragma once
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "debugutils.h"
+
+// Bump allocator for arrays of trivially copyable types.
+// Nothing is freed until the arena is released or destroyed, when all
+// blocks go back at once. Not thread safe.
+class Arena {
+	public:
+		Arena(size_t _block_size = 1 << 20):
+			block_size(_block_size), cur(NULL), left(0) {}
+		~Arena() { release(); }
+
+		// n uninitialized elements
+		template <typename T>
+		T* alloc(size_t n) {
+			size_t bytes = (n * sizeof(T) + 15) & ~(size_t)15;
+			if (bytes > left) grow(bytes);
+			T* ret = (T*)cur;
+			cur += bytes;
+			left -= bytes;
+			return ret;
+		}
+
+		template <typename T>
+		T* alloc_zero(size_t n) {
+			T* ret = alloc<T>(n);
+			memset(ret, 0, n * sizeof(T));
+			return ret;
+		}
+
+		void release() {
+			for (auto b : blocks) ::free(b);
+			blocks.clear();
+			cur = NULL;
+			left = 0;
+		}
+
+	private:
+		size_t block_size;
+		std::vector<char*> blocks;
+		char* cur;
+		size_t left;
+
+		void grow(size_t bytes) {
+			size_t size = std::max(block_size, bytes);
+			cur = (char*)malloc(size);
+			m_assert(cur != NULL);
+			blocks.emplace_back(cur);
+			left = size;
+		}
+
+		Arena(const Arena&);
+		Arena& operator = (const Arena&);
+};
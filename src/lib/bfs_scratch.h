@@ -0,0 +1,112 @@
+//File: bfs_scratch.h
+//Date: Sat Oct 17 21:47:30 2026 +0000
+
+
+#pragma once
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// Visited set with O(1) clear: v is visited iff stamp[v] == epoch.
+class EpochVisited {
+	public:
+		EpochVisited(): epoch(0) {}
+
+		// forget all visited vertices, make room for n vertices
+		void clear(size_t n) {
+			if (stamp.size() < n)
+				stamp.resize(n, 0);
+			if (++ epoch == 0) {		// wrapped, stamps are ambiguous
+				std::fill(stamp.begin(), stamp.end(), 0);
+				epoch = 1;
+			}
+		}
+
+		bool test(int v) const { return stamp[v] == epoch; }
+		void set(int v) { stamp[v] = epoch; }
+
+		// return true if v was not visited
+		bool test_and_set(int v) {
+			if (stamp[v] == epoch) return false;
+			stamp[v] = epoch;
+			return true;
+		}
+
+	private:
+		std::vector<uint32_t> stamp;
+		uint32_t epoch;
+};
+
+// FIFO on a ring buffer of power-of-two capacity, kept between searches
+class RingQueue {
+	public:
+		RingQueue(): mask(0), head(0), tail(0) {}
+
+		// empty the queue, make room for n elements
+		void clear(size_t n) {
+			if (buf.size() < n) {
+				size_t cap = 1;
+				while (cap < n) cap <<= 1;
+				buf.resize(cap);
+				mask = cap - 1;
+			}
+			head = tail = 0;
+		}
+
+		void push(int v) { buf[tail ++ & mask] = v; }
+		int pop() { return buf[head ++ & mask]; }
+		int front() const { return buf[head & mask]; }
+		size_t size() const { return tail - head; }
+		bool empty() const { return head == tail; }
+
+	private:
+		std::vector<int> buf;
+		size_t mask, head, tail;
+};
+
+// MARK_INF plus a distance stays larger than any distance
+const int MARK_INF = 1000000000;
+
+// the two sides of bidir_bfs, defined in graph_kernel.cpp
+struct BidirSides;
+
+// Scratch of one thread for one search at a time, shared by all searches
+// of the thread. Kept between searches, and freed when the thread exits.
+struct BFSScratch {
+	EpochVisited visited;
+	RingQueue queue;
+	// a value per vertex, MARK_INF between searches: a search resets what it sets
+	std::vector<int> mark;
+	// bit masks per vertex of multi-source searches (msbfs, closeness
+	// batches), all zero between searches
+	std::vector<uint64_t> seen, frontier, next;
+	std::vector<int> active, touched;
+	std::shared_ptr<BidirSides> bidir;
+
+	// start a search on a graph of n vertices
+	void start(size_t n) {
+		visited.clear(n);
+		queue.clear(n);
+	}
+
+	void reserve_mark(size_t n) {
+		if (mark.size() < n)
+			mark.resize(n, MARK_INF);
+	}
+
+	void reserve_masks(size_t n) {
+		if (seen.size() < n) {
+			seen.resize(n, 0);
+			frontier.resize(n, 0);
+			next.resize(n, 0);
+		}
+	}
+
+	// scratch of the calling thread
+	static BFSScratch& local() {
+		static thread_local BFSScratch s;
+		return s;
+	}
+};
@@ -0,0 +1,41 @@
+//File: csr_graph.h
+//Date: Sat Oct 17 19:05:12 2026 +0000
+
+
+#pragma once
+#include <vector>
+
+// Unweighted graph in compressed sparse row form:
+// neighbors of vertex i are adj[offset[i]] ... adj[offset[i + 1] - 1]
+class CSRGraph {
+	public:
+		std::vector<int> offset;		// size n + 1
+		std::vector<int> adj;
+
+		class Neighbors {
+			const int *b, *e;
+			public:
+				Neighbors(const int* _b, const int* _e):
+					b(_b), e(_e) {}
+
+				const int* begin() const { return b; }
+				const int* end() const { return e; }
+				size_t size() const { return (size_t)(e - b); }
+				bool empty() const { return b == e; }
+				int operator [] (size_t k) const { return b[k]; }
+		};
+
+		CSRGraph(): offset(1, 0) {}
+
+		Neighbors operator [] (int i) const {
+			const int* p = adj.data();
+			return Neighbors(p + offset[i], p + offset[i + 1]);
+		}
+
+		size_t size() const { return offset.size() - 1; }
+		size_t nr_edge() const { return adj.size(); }
+
+		// append a vertex whose neighbors are filled by push_back() afterwards
+		void add_vertex() { offset.emplace_back(offset.back()); }
+		void push_back(int v) { adj.emplace_back(v); offset.back() ++; }
+};
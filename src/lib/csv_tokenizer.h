@@ -0,0 +1,203 @@
+//File: csv_tokenizer.h
+//Date: Sat Oct 17 17:52:06 2026 +0000
+
+
+#pragma once
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "debugutils.h"
+
+// Tokenizer for the '|' separated csv files.
+// Delimiters ('|' and '\n') are located one SIMD block at a time:
+// each block gives a bitmask of delimiter positions, and fields are popped
+// from the mask without looking at the bytes in between.
+// Integer fields are converted eight digits at a time (SWAR).
+//
+// Every row ends with '\n', except that the last one may end at the end of
+// the buffer.
+
+namespace __CSVTokenizerImpl {
+#ifdef __AVX2__
+	const int BLOCK = 32;
+	typedef uint32_t mask_t;
+	inline mask_t delim_mask(const char* p) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		__m256i d = _mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+		return (mask_t)_mm256_movemask_epi8(d);
+	}
+#else
+	const int BLOCK = 16;
+	typedef uint32_t mask_t;
+	inline mask_t delim_mask(const char* p) {
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		__m128i d = _mm_or_si128(
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('|')),
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+		return (mask_t)_mm_movemask_epi8(d);
+	}
+#endif
+
+	// convert 1 ~ 8 ascii digits; 8 bytes starting from p must be readable
+	inline uint64_t parse_digits8(const char* p, int len) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		v -= 0x3030303030303030ULL;		// bytes after the digits are shifted out below
+		v <<= 8 * (8 - len);			// leading zero digits
+		v = (v * 10) + (v >> 8);
+		v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+				(((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+		return v;
+	}
+}
+
+class CSVTokenizer {
+	public:
+		CSVTokenizer(const char* _begin, const char* _end):
+			ptr(_begin), begin(_begin), end(_end),
+			next_block(0), mask(0) {}
+
+		bool eof() const { return ptr >= end; }
+
+		const char* position() const { return ptr; }
+
+		// next field is [b, e). return true if it is the last one in its row
+		bool next_field(const char*& b, const char*& e) {
+			b = ptr;
+			e = next_delim();
+			ptr = e == end ? end : e + 1;
+			return e == end or *e == '\n';
+		}
+
+		unsigned long long next_ull() {
+			const char *b, *e;
+			next_field(b, e);
+			return to_ull(b, e);
+		}
+
+		int next_int()
+		{ return (int)next_ull(); }
+
+		std::string next_str() {
+			const char *b, *e;
+			next_field(b, e);
+			return std::string(b, e);
+		}
+
+		// skip the remaining fields of current row
+		void skip_line() {
+			const char *e;
+			do {
+				e = next_delim();
+			} while (e != end and *e != '\n');
+			ptr = e == end ? end : e + 1;
+		}
+
+		// read the first n integer fields of the next row, and skip the rest.
+		// return false at the end of buffer
+		template <typename T>
+		bool next_row(T* fields, int n) {
+			if (eof()) return false;
+			for (int i = 0; i < n; i ++) {
+				const char *b, *e;
+				bool eol = next_field(b, e);
+				fields[i] = (T)to_ull(b, e);
+				if (eol) {
+					for (i ++; i < n; i ++)
+						fields[i] = 0;
+					return true;
+				}
+			}
+			skip_line();
+			return true;
+		}
+
+		// non-negative integer in [b, e). non-digits are not checked
+		unsigned long long to_ull(const char* b, const char* e) const {
+			int len = (int)(e - b);
+			if (len <= 0) return 0;
+			if (len > 8) {
+				const char* mid = e - 8;
+				return to_ull(b, mid) * 100000000ULL + to_ull(mid, e);
+			}
+			if (end - b >= 8)
+				return __CSVTokenizerImpl::parse_digits8(b, len);
+			unsigned long long ret = 0;
+			for (; b != e; b ++)
+				ret = ret * 10 + (unsigned long long)(*b - '0');
+			return ret;
+		}
+
+	private:
+		const char* ptr;		// beginning of next field
+		const char *begin, *end;
+		// offset of the block after the current one, which starts at
+		// next_block - BLOCK. an offset, so no pointer leaves the buffer
+		size_t next_block;
+		__CSVTokenizerImpl::mask_t mask;		// delimiters in block not yet popped
+
+		const char* next_delim() {
+			using namespace __CSVTokenizerImpl;
+			size_t size = (size_t)(end - begin);
+			while (mask == 0) {
+				if (next_block >= size)
+					return end;
+				const char* block = begin + next_block;
+				if (size - next_block >= (size_t)BLOCK)
+					mask = delim_mask(block);
+				else {
+					char tail[BLOCK];
+					memset(tail, 0, sizeof(tail));
+					memcpy(tail, block, size - next_block);
+					mask = delim_mask(tail);
+				}
+				next_block += BLOCK;
+			}
+			const char* ret = begin + (next_block - BLOCK) + __builtin_ctz(mask);
+			mask &= mask - 1;
+			return ret;
+		}
+};
+
+// read-only mmap of a whole file
+class MMapFile {
+	public:
+		MMapFile(const std::string& fname, int advice = MADV_SEQUENTIAL):
+			mapped(NULL), size(0) {
+			fd = open(fname.c_str(), O_RDONLY);
+			m_assert(fd >= 0);
+			struct stat s; fstat(fd, &s);
+			size = (size_t)s.st_size;
+			if (size) {
+				mapped = mmap(0, size, PROT_READ, MAP_FILE|MAP_PRIVATE, fd, 0);
+				m_assert(mapped != MAP_FAILED);
+				madvise(mapped, size, advice);
+			}
+		}
+
+		~MMapFile() {
+			if (mapped) munmap(mapped, size);
+			close(fd);
+		}
+
+		char* begin() const { return (char*)mapped; }
+		char* end() const { return (char*)mapped + size; }
+
+	private:
+		int fd;
+		void* mapped;
+		size_t size;
+
+		MMapFile(const MMapFile&);
+		MMapFile& operator = (const MMapFile&);
+};
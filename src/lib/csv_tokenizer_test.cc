@@ -0,0 +1,51 @@
+//File: csv_tokenizer_test.cc
+//Date: Sat Oct 17 18:20:31 2026 +0000
+
+#include "csv_tokenizer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#define CHECK(expr) \
+	if (not (expr)) { \
+		fprintf(stderr, "%s:%d check failed: %s\n", __FILE__, __LINE__, # expr); \
+		exit(1); \
+	}
+
+int main() {
+	// integers of every length, rows longer than a block
+	std::string csv = "id|value|text\n";
+	unsigned long long x = 0;
+	for (int i = 0; i < 1000; i ++) {
+		x = x * 7 + (unsigned long long)i;
+		x %= 10000000000000000000ULL;
+		csv += std::to_string(i) + "|" + std::to_string(x) + "|"
+			+ std::string((size_t)(i % 50), 'a') + "\n";
+	}
+	csv += "7|8";		// last row without '\n'
+
+	CSVTokenizer tk(csv.data(), csv.data() + csv.size());
+	CHECK(tk.next_str() == "id");
+	tk.skip_line();
+	x = 0;
+	unsigned long long row[2];
+	for (int i = 0; i < 1000; i ++) {
+		x = x * 7 + (unsigned long long)i;
+		x %= 10000000000000000000ULL;
+		CHECK(tk.next_row(row, 2));
+		CHECK(row[0] == (unsigned long long)i);
+		CHECK(row[1] == x);
+	}
+	int last[3];
+	CHECK(tk.next_row(last, 3));
+	CHECK(last[0] == 7 && last[1] == 8 && last[2] == 0);
+	CHECK(not tk.next_row(last, 3));
+
+	const char* date = "1989-12-03|";
+	CSVTokenizer dt(date, date + 11);
+	CHECK(dt.to_ull(date, date + 4) == 1989);
+	CHECK(dt.to_ull(date + 5, date + 7) == 12);
+	CHECK(dt.to_ull(date + 8, date + 10) == 3);
+	printf("ok\n");
+}
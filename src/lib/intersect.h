@@ -0,0 +1,36 @@
+//File: intersect.h
+//Date: Sat Oct 17 23:26:02 2026 +0000
+
+
+#pragma once
+#include <emmintrin.h>
+#include <cstdint>
+
+// Size of the intersection of two sorted arrays of distinct values.
+// Blocks of four are compared all-against-all with SSE2 (each block of b
+// rotated three times), and the block with the smaller maximum advances.
+inline int intersect_count(const uint32_t* a, int na, const uint32_t* b, int nb) {
+	int i = 0, j = 0, cnt = 0;
+	int na4 = na & ~3, nb4 = nb & ~3;
+	while (i < na4 && j < nb4) {
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+		__m128i m = _mm_or_si128(
+				_mm_or_si128(
+					_mm_cmpeq_epi32(va, vb),
+					_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+				_mm_or_si128(
+					_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+					_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+		cnt += __builtin_popcount((unsigned)_mm_movemask_ps(_mm_castsi128_ps(m)));
+		uint32_t amax = a[i + 3], bmax = b[j + 3];
+		if (amax <= bmax) i += 4;
+		if (bmax <= amax) j += 4;
+	}
+	while (i < na && j < nb) {
+		if (a[i] < b[j]) i ++;
+		else if (a[i] > b[j]) j ++;
+		else cnt ++, i ++, j ++;
+	}
+	return cnt;
+}
@@ -0,0 +1,39 @@
+//File: intersect_test.cc
+//Date: Sat Oct 17 23:26:02 2026 +0000
+
+#include "intersect.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <set>
+#include <iterator>
+
+#define CHECK(expr) \
+	if (not (expr)) { \
+		fprintf(stderr, "%s:%d check failed: %s\n", __FILE__, __LINE__, # expr); \
+		exit(1); \
+	}
+
+std::vector<uint32_t> random_set(int n, int range) {
+	std::set<uint32_t> s;
+	while ((int)s.size() < n)
+		s.insert((uint32_t)(rand() % range));
+	return std::vector<uint32_t>(s.begin(), s.end());
+}
+
+int main() {
+	srand(42);
+	for (int iter = 0; iter < 100000; iter ++) {
+		int range = 1 + rand() % 200;
+		std::vector<uint32_t> a = random_set(rand() % std::min(range + 1, 40), range),
+			b = random_set(rand() % std::min(range + 1, 40), range);
+		std::vector<uint32_t> c;
+		std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+				std::back_inserter(c));
+		CHECK(intersect_count(a.data(), (int)a.size(), b.data(), (int)b.size()) == (int)c.size());
+		CHECK(intersect_count(b.data(), (int)b.size(), a.data(), (int)a.size()) == (int)c.size());
+	}
+	printf("ok\n");
+}
@@ -3,6 +3,7 @@
 
 
 #include <cstdio>
+#include <cstdlib>
 #include <string.h>
 #include <string>
 #include <omp.h>
@@ -11,12 +12,15 @@
 #include "lib/hash_lib.h"
 #include "lib/allocator.hh"
 #include "lib/Timer.h"
+#include "lib/TaskGraph.hh"
 #include "lib/debugutils.h"
 #include "lib/common.h"
 #include "data.h"
 #include "job_wrapper.h"
 #include "cache.h"
 #include "read.h"
+#include "snapshot.h"
+#include "server.h"
 
 #include "query1.h"
 #include "query2.h"
@@ -94,17 +98,57 @@ int main(int argc, char* argv[]) {
 	q4_tag_set.set_empty_key("");
 	q4_persons.set_empty_key("");
 	Data::placeid.set_empty_key("");
+	Data::tagid.set_empty_key("");
 #endif
 	// end
 	string dir(argv[1]);
 
-	read_query(string(argv[2]));		// read query first, so we can read data optionally later
-	q4.ans.resize(q4_set.size());
-	q3.global_answer.resize(q3_set.size());
+	// main <data dir> --serve [socket path]: load once, then answer queries
+	// from stdin or the socket, see server.h
+	if (argc > 2 && string(argv[2]) == "--serve") {
+		server_mode = true;
+		q2.online = true;
+	} else {
+		read_query(string(argv[2]));		// read query first, so we can read data optionally later
+		q4.ans.resize(q4_set.size());
+		q3.global_answer.resize(q3_set.size());
+	}
 
-	threadpool->enqueue(bind(do_read_comments, dir), start_1, 20);
-	read_data(dir);
-	print_debug("Read return at %lf secs\n", timer.get_time());
+	// every stage with the data it reads; a cleanup stage comes after the
+	// last stage using what it frees
+	TaskGraph stages(threadpool);
+	int persons, friends, comments, tags, places, forums;
+	const char* snapshot_path = getenv("GRAPH_SNAPSHOT");		// opt-in, see snapshot.h
+	if (snapshot_load(dir, snapshot_path)) {		// warm start, everything is loaded
+		persons = friends = comments = tags = places = forums =
+			stages.add("snapshot", nullptr);
+	} else {
+		snapshot_begin(dir, snapshot_path);
+		persons = stages.add("persons", bind(read_person_file, dir), {}, 20);
+		int owners = stages.add("comment owners", bind(read_comment_owners, dir), {}, 20);
+		friends = stages.add("knows", bind(read_person_knows_person, dir), {persons}, 20);
+		int hash = stages.add("friends hash", build_friends_hash, {friends}, 20);
+		comments = stages.add("comments", bind(do_read_comments, dir), {owners, hash}, 20);
+		tags = stages.add("tags", bind(read_tags, dir), {persons}, 20);
+		places = stages.add("places", bind(read_places, dir), {tags}, 20);
+		forums = stages.add("forums", bind(read_forums, dir), {tags}, 20);
+		if (snapshot_collecting())
+			stages.add("write snapshot", snapshot_write,
+					{persons, comments, tags, places, forums}, -1);
+	}
+	if (server_mode) {
+		// build the q2 timeline and the q1 components. nothing is freed,
+		// run() returns once all data is loaded
+		stages.add("q1", bind(&Query1Handler::prepare_online, &q1), {comments}, 20);
+		stages.add("q2", start_2, {friends, tags});
+	} else {
+		stages.add("q1", start_1, {comments}, 20);
+		int q2s = stages.add("q2", start_2, {friends, tags});
+		int q3s = stages.add("q3", start_3, {friends, tags, places});
+		stages.add("q4", start_4, {friends, forums}, 10);
+		stages.add("free tag names", destroy_tag_name, {q2s, forums});
+		stages.add("free q3 data", destroy_q3_data, {q2s, q3s});
+	}
 	/*
 	 *if (Data::nperson > 10000) {
 	 *    fprintf(stderr, "th:%dmem:%d\n", thread::hardware_concurrency(), get_free_mem());
@@ -116,16 +160,20 @@ int main(int argc, char* argv[]) {
 	 *}
 	 */
 
-	threadpool->enqueue(bind(do_read_tags_forums_places, dir), start_4);
-	WAIT_FOR(tag_read);
-	threadpool->enqueue(start_2);
-	start_3();
-	/*
-	 *WAIT_FOR(comment_read);
-	 *threadpool->add_worker(4);
-	 */
+	stages.run();
+	if (Data::nperson > 11000)
+		stages.print_critical_path();
+
+	if (server_mode) {
+		fprintf(stderr, "loaded in %.4lf secs\n", timer.get_time());
+		if (argc > 3)
+			serve_socket(argv[3]);
+		else
+			serve_stream(stdin, stdout);
+		delete threadpool;
+		return 0;
+	}
 	PP("deleting...");
-	threadpool->condition.notify_all();
 	delete threadpool;		// will wait to join all thread
 
 	q1.print_result();
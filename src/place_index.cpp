@@ -0,0 +1,116 @@
+//File: place_index.cpp
+//Date: Sat Oct 17 22:10:05 2026 +0000
+
+
+#include <algorithm>
+
+#include "place_index.h"
+#include "data.h"
+#include "lib/common.h"
+#include "lib/utils.h"
+#include "lib/Timer.h"
+using namespace std;
+
+void PlaceIndex::build() {
+	GuardedTimer timer("build place index");
+	int nplace = (int)Data::places.size();
+	vector<int> nparent(nplace, 0);
+	FOR_ITR(p, Data::places) FOR_ITR(s, p->sub_places)
+		nparent[*s - Data::places.data()] ++;
+
+	// iterative dfs from every root. a place with several parents is
+	// only placed under the first one reaching it
+	tin.assign(nplace, -1);
+	tout.assign(nplace, -1);
+	vector<int> order;		// place at each position
+	order.reserve(nplace);
+	vector<pair<int, int>> stack;		// (place, next child)
+	REP(root, nplace) {
+		if (nparent[root] or tin[root] != -1) continue;
+		tin[root] = (int)order.size();
+		order.emplace_back(root);
+		stack.emplace_back(root, 0);
+		while (not stack.empty()) {
+			auto& top = stack.back();
+			auto& sub = Data::places[top.first].sub_places;
+			if (top.second == (int)sub.size()) {
+				tout[top.first] = (int)order.size();
+				stack.pop_back();
+				continue;
+			}
+			int s = (int)(sub[top.second ++] - Data::places.data());
+			if (tin[s] != -1) continue;
+			tin[s] = (int)order.size();
+			order.emplace_back(s);
+			stack.emplace_back(s, 0);
+		}
+	}
+	// places on a cycle without a root
+	REP(i, nplace) if (tin[i] == -1) {
+		tin[i] = (int)order.size();
+		tout[i] = tin[i] + 1;
+		order.emplace_back(i);
+	}
+
+	offset.assign(1, 0);
+	offset.reserve(nplace + 1);
+	person.clear();
+	FOR_ITR(p, order) {
+		FOR_ITR(pp, Data::places[*p].persons)
+			person.emplace_back(pp->pid);
+		offset.emplace_back((int)person.size());
+	}
+}
+
+vector<pair<int, int>> PlaceIndex::ranges(const string& name) const {
+	vector<pair<int, int>> ret;
+	auto itr = Data::placeid.find(name);
+	if (itr == Data::placeid.end()) return ret;
+	FOR_ITR(p, itr->second)
+		if (*p >= 0 and *p < (int)tin.size())
+			ret.emplace_back(tin[*p], tout[*p]);
+	sort(ret.begin(), ret.end());
+	// subtrees are either nested or disjoint
+	size_t n = 0;
+	FOR_ITR(r, ret) {
+		if (n and r->first < ret[n - 1].second)
+			ret[n - 1].second = max(ret[n - 1].second, r->second);
+		else
+			ret[n ++] = *r;
+	}
+	ret.resize(n);
+	return ret;
+}
+
+shared_ptr<const vector<int>> PlaceIndex::persons_of(const string& name) const {
+	{
+		lock_guard<mutex> lg(cache_mt);
+		auto itr = cache.find(name);
+		if (itr != cache.end())
+			return itr->second;
+	}
+	shared_ptr<vector<int>> ret = make_shared<vector<int>>();
+	auto rs = ranges(name);
+	FOR_ITR(r, rs)
+		ret->insert(ret->end(), person.begin() + offset[r->first],
+				person.begin() + offset[r->second]);
+	sort(ret->begin(), ret->end());
+	ret->resize(unique(ret->begin(), ret->end()) - ret->begin());
+	if (rs.empty())		// not a place, not kept
+		return ret;
+
+	lock_guard<mutex> lg(cache_mt);
+	auto& slot = cache[name];
+	if (not slot)		// another query of the name may have filled it
+		slot = ret;
+	return slot;
+}
+
+void PlaceIndex::free() {
+	FreeAll(tin);
+	FreeAll(tout);
+	FreeAll(offset);
+	FreeAll(person);
+	lock_guard<mutex> lg(cache_mt);
+	cache.clear();
+}
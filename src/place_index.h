@@ -0,0 +1,47 @@
+//File: place_index.h
+//Date: Sat Oct 17 22:10:05 2026 +0000
+
+
+#pragma once
+#include <vector>
+#include <string>
+#include <utility>
+#include <memory>
+#include <mutex>
+#include "lib/hash_lib.h"
+
+// The place tree flattened in DFS (Euler tour) order.
+// Subtree of a place is a contiguous range of tour positions, and persons
+// are bucketed by the position of their place, so all persons under a
+// place are one contiguous slice of a flat array.
+class PlaceIndex {
+	public:
+		PlaceIndex() {
+#ifdef GOOGLE_HASH
+			cache.set_empty_key("");
+#endif
+		}
+
+		// from Data::places, after their persons are filled
+		void build();
+
+		// tour ranges [l, r) of all places named name, merged and sorted
+		std::vector<std::pair<int, int>> ranges(const std::string& name) const;
+
+		// pid of persons in places named name and their sub places.
+		// sorted and unique. computed once per name, then shared
+		std::shared_ptr<const std::vector<int>> persons_of(const std::string& name) const;
+
+		void free();
+
+	private:
+		std::vector<int> tin, tout;		// subtree of place i: [tin[i], tout[i])
+		std::vector<int> offset;		// persons at position t: person[offset[t] ... offset[t + 1] - 1]
+		std::vector<int> person;
+
+		// a person may be in several places of a subtree, so the union of
+		// the slices is sorted and deduplicated on the first query of a name
+		mutable std::mutex cache_mt;
+		mutable unordered_map<std::string, std::shared_ptr<const std::vector<int>>,
+				StringHashFunc> cache;
+};
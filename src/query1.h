@@ -6,6 +6,8 @@
 #include <mutex>
 #include "lib/hash_lib.h"
 #include "lib/finish_time_continuation.h"
+#include "component_index.h"
+#include "landmark_index.h"
 #include <map>
 
 struct Query1 {
@@ -14,12 +16,40 @@ struct Query1 {
 		p1(_p1), p2(_p2), x(_x){}
 };
 
+int bfs2(int p1, int p2, int x);
+
+// Bit-parallel multi-source BFS (MS-BFS) for up to MSBFS_WIDTH Query1 of the
+// same threshold x: every vertex keeps one bit per search, so a single
+// scan of the graph advances all searches by one level.
+const int MSBFS_WIDTH = 64;
+// fewer queries of one threshold are cheaper with bfs2
+const int MSBFS_MIN_BATCH = 8;
+// fill ans[i] = dist(p1[i], p2[i]) through edges with ncmts > x, or -1
+void msbfs(const int* p1, const int* p2, int n, int x, int* ans);
+
+#ifdef USE_LANDMARK_INDEX
+// thresholds asked at least this many times get a LandmarkIndex
+const size_t LANDMARK_MIN_QUERY = 1024;
+// give up (and use bfs) beyond this many labels per person on average
+const size_t LANDMARK_MAX_LABEL = 64;
+#endif
+
 class Query1Handler {
 	public:
 		void pre_work();
 
 		void add_query(const Query1 & q, int ind);
 
+		// answer all queries on the threadpool, batched by threshold.
+		// return once all of them are answered
+		void add_queries(const std::vector<Query1>& qs);
+
+		// once comments are read, in server mode: components of every x
+		void prepare_online();
+
+		// answer a single query, in server mode
+		int answer(const Query1& q) const;
+
 		void work();
 
 		void print_result();		// TODO
@@ -27,6 +57,17 @@ class Query1Handler {
 		std::shared_ptr<FinishTimeContinuation> continuation;
 
 	protected:
-		std::vector<std::pair<int, int>> ans;
-		std::mutex ans_mt;
+		void add_answer(int ind, int ans);
+		// queries ids, all with threshold x
+		void run_batch(const std::vector<Query1>* qs, std::vector<int> ids, int x);
+		// enqueue run_batch tasks for ids
+		void schedule_search(const std::vector<Query1>* qs, const std::vector<int>& ids, int x);
+#ifdef USE_LANDMARK_INDEX
+		// build a LandmarkIndex for x and answer ids with it
+		void run_landmark(const std::vector<Query1>* qs, std::vector<int> ids, int x);
+#endif
+
+		std::vector<int> ans;		// one slot per query
+		ComponentIndex components;
+		TaskGroup* tasks;		// of the running add_queries
 };
@@ -5,84 +5,179 @@
 #include "lib/common.h"
 #include "data.h"
 #include "bread.h"
+#include "graph_kernel.h"
+#include "lib/bfs_scratch.h"
 #include <cstdio>
 #include <queue>
 #include <algorithm>
 #include <vector>
 using namespace std;
 
+namespace {
+	typedef uint64_t mask_t;
+}
+
 int bfs2(int p1, int p2, int x) {			// 10k: 0.014sec / 1500queries
-	if (p1 == p2) return 0;
-	vector<bool> vst1(Data::nperson, false);
-	vector<bool> vst2(Data::nperson, false);
-	deque<int> q1, q2;
-	q1.push_back(p1); vst1[p1] = true;
-	q2.push_back(p2); vst2[p2] = true;
-	int depth1 = 0, depth2 = 0;
-	while (true) {
-		size_t s1 = q1.size(), s2 = q2.size();
-		if (!s1 or !s2) break;
-
-		depth1 ++;
-		REP(k, s1) {
-			int now_ele = q1.front();
-			q1.pop_front();
-			auto& friends = Data::friends[now_ele];
-			for (auto it = friends.begin(); it != friends.end(); it ++) {
-				int person = it -> pid;
-				if (x >= 0) {
-					/*
-					 *if (not mybread.check(now_ele, person, x))
-					 *    continue;
-					 */
-					if (it->ncmts <= x) continue;
-				}
-				// TODO friends is not sorted by cmt because cmt is read later
-				if (not vst1[person]) {
-					if (vst2[person]) return depth1 + depth2;
-					q1.push_back(person);
-					vst1[person] = true;
-				}
-			}
+	return bidir_bfs(p1, p2, x);
+}
+
+
+void msbfs(const int* p1, const int* p2, int n, int x, int* ans) {
+	m_assert(n <= MSBFS_WIDTH);
+	BFSScratch& bs = BFSScratch::local();
+	bs.reserve_masks(Data::nperson);
+	mask_t *seen = bs.seen.data(), *visit = bs.frontier.data(), *next = bs.next.data();
+
+	mask_t remain = 0;		// searches still running
+	REP(i, n) {
+		if (p1[i] == p2[i]) {
+			ans[i] = 0;
+			continue;
 		}
+		ans[i] = -1;
+		mask_t bit = 1ULL << i;
+		remain |= bit;
+		seen[p1[i]] |= bit;
+		visit[p1[i]] |= bit;
+	}
 
-		depth2 ++;
-		REP(k, s2) {
-			int now_ele = q2.front();
-			q2.pop_front();
-			auto& friends = Data::friends[now_ele];
+	for (int depth = 1; remain; depth ++) {
+		bool active = false;
+		REP(v, Data::nperson) {
+			mask_t m = visit[v] & remain;
+			if (not m) continue;
+			auto friends = Data::friends.by_cmts(v);
 			for (auto it = friends.begin(); it != friends.end(); it ++) {
-				int person = it -> pid;
-				// TODO friends is not sorted by cmt because cmt is read later
-				if (x >= 0) {
-					if (it->ncmts <= x) continue;
-					/*
-					 *if (not mybread.check(now_ele, person, x))
-					 *    continue;
-					 */
-				}
-				if (not vst2[person]) {
-					if (vst1[person]) return depth1 + depth2;
-					q2.push_back(person);
-					vst2[person] = true;
-				}
+				if (it->ncmts <= x) break;		// sorted by ncmts
+				next[it->pid] |= m;
+			}
+		}
+		REP(v, Data::nperson) {
+			mask_t m = next[v] & ~seen[v];
+			seen[v] |= m;
+			visit[v] = m;
+			next[v] = 0;
+			if (m) active = true;
+		}
+		REP(i, n) {
+			mask_t bit = 1ULL << i;
+			if ((remain & bit) and (seen[p2[i]] & bit)) {
+				ans[i] = depth;
+				remain &= ~bit;
 			}
 		}
+		if (not active) break;
 	}
-	return -1;
+	// next is all zero again
+	fill(seen, seen + Data::nperson, 0);
+	fill(visit, visit + Data::nperson, 0);
 }
 
+void Query1Handler::add_answer(int ind, int ans) {
+	this->ans[ind] = ans;		// each query owns its slot
+	if (Data::nperson > 10001)
+		continuation->cont();
+}
 
 void Query1Handler::add_query(const Query1& q, int ind) {
-	int ans = bfs2(q.p1, q.p2, q.x);
-	{
-		std::lock_guard<mutex> lock(ans_mt);
-		this->ans.emplace_back(ind, ans);
+	add_answer(ind, bfs2(q.p1, q.p2, q.x));
+}
+
+void Query1Handler::run_batch(const vector<Query1>* qs, vector<int> ids, int x) {
+	if ((int)ids.size() < MSBFS_MIN_BATCH) {
+		FOR_ITR(itr, ids)
+			add_query((*qs)[*itr], *itr);
+		return;
 	}
-	if (Data::nperson > 10001)
-		continuation->cont();
+	int n = (int)ids.size();
+	int p1[MSBFS_WIDTH], p2[MSBFS_WIDTH], res[MSBFS_WIDTH];
+	REP(k, n) {
+		p1[k] = (*qs)[ids[k]].p1;
+		p2[k] = (*qs)[ids[k]].p2;
+	}
+	msbfs(p1, p2, n, x, res);
+	REP(k, n)
+		add_answer(ids[k], res[k]);
 }
 
+void Query1Handler::add_queries(const vector<Query1>& qs) {
+	ans.assign(qs.size(), -1);
+
+	vector<int> xs;
+	FOR_ITR(itr, qs) xs.emplace_back(itr->x);
+	components.build(xs);
+
+	// pairs in different components are answered here,
+	// so a search never has to exhaust a component to return -1
+	map<int, vector<int>> by_x;		// x -> query indices
+	REP(i, qs.size()) {
+		auto& q = qs[i];
+		if (q.p1 == q.p2)
+			add_answer((int)i, 0);
+		else if (not components.connected(q.x, q.p1, q.p2))
+			add_answer((int)i, -1);
+		else
+			by_x[q.x].emplace_back((int)i);
+	}
+
+	TaskGroup group(threadpool, 20);
+	tasks = &group;
+	FOR_ITR(ids, by_x) {
+#ifdef USE_LANDMARK_INDEX
+		if (ids->second.size() >= LANDMARK_MIN_QUERY) {
+			group.run(bind(&Query1Handler::run_landmark,
+						this, &qs, ids->second, ids->first));
+			continue;
+		}
+#endif
+		schedule_search(&qs, ids->second, ids->first);
+	}
+	group.wait();
+	tasks = NULL;
+}
+
+void Query1Handler::prepare_online() {
+	components.build_all();
+}
+
+int Query1Handler::answer(const Query1& q) const {
+	if (q.p1 == q.p2)
+		return 0;
+	if (not components.connected(q.x, q.p1, q.p2))
+		return -1;
+	return bfs2(q.p1, q.p2, q.x);
+}
+
+void Query1Handler::schedule_search(const vector<Query1>* qs, const vector<int>& ids, int x) {
+	// a group too small for msbfs is cut into bfs2 tasks of this size
+	const size_t BFS2_BATCH = 4;
+	size_t step = ids.size() < (size_t)MSBFS_MIN_BATCH ? BFS2_BATCH : MSBFS_WIDTH;
+	for (size_t b = 0; b < ids.size(); b += step) {
+		vector<int> batch(ids.begin() + b, ids.begin() + min(b + step, ids.size()));
+		tasks->run(bind(&Query1Handler::run_batch, this, qs, batch, x));
+	}
+}
+
+#ifdef USE_LANDMARK_INDEX
+void Query1Handler::run_landmark(const vector<Query1>* qs, vector<int> ids, int x) {
+	// the index of one threshold is built on the whole pool, while
+	// tasks of other thresholds keep running
+	Timer timer;
+	LandmarkIndex index;
+	if (not index.build(x, LANDMARK_MAX_LABEL * (size_t)Data::nperson)) {
+		fprintf(stderr, "landmark index x=%d too large, use bfs\n", x);
+		schedule_search(qs, ids, x);
+		return;
+	}
+	fprintf(stderr, "landmark index x=%d: %.2lf MB, %.4lf secs\n",
+			x, (double)index.memory() / 1024 / 1024, timer.get_time());
+	FOR_ITR(itr, ids) {
+		auto& q = (*qs)[*itr];
+		add_answer(*itr, index.query(q.p1, q.p2));
+	}
+}
+#endif
+
 void Query1Handler::pre_work() {
 	/*
 	 *REP(i, Data::nperson) {
@@ -94,10 +189,6 @@ void Query1Handler::pre_work() {
 void Query1Handler::work() {}
 
 void Query1Handler::print_result() {
-//    FOR_ITR(it, ans)
-//        printf("%d\n", it->second);
-	sort(ans.begin(), ans.end());
-	REP(k, ans.size()) {
-		printf("%d\n", ans[k].second);
-	}
+	FOR_ITR(itr, ans)
+		printf("%d\n", *itr);
 }
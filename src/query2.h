@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "lib/finish_time_continuation.h"
+#include "tag_timeline.h"
 
 struct Query2 {
 	int k, d, qid;
@@ -17,14 +18,24 @@ struct Query2 {
 
 class Query2Handler {
 	public:
+		Query2Handler(): online(false) {}
+
 		void add_query(const Query2& q);
 
 		void work();
 
 		void print_result();
 
+		// answer a query after work(), in online mode
+		std::vector<std::string> answer(int k, int d) const;
+
 		std::shared_ptr<FinishTimeContinuation> continuation;
 
+		// set before work(): sweep all birthdays once into a timeline,
+		// which is kept to answer any later query
+		bool online;
+
 	protected:
         std::vector<std::vector<std::string>> all_ans;
+		TagTimeline timeline;
 };
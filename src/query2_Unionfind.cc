@@ -1,12 +1,14 @@
 #include "query2.h"
 #include "data.h"
+#include "globals.h"
 #include "lib/debugutils.h"
 #include "heap.h"
 #include "lib/utils.h"
 #include <vector>
+#include <queue>
+#include <functional>
 #include <cstdio>
 #include <algorithm>
-#include "lib/hash_lib.h"
 
 extern vector<Query2> q2_set;
 #define queries q2_set
@@ -16,10 +18,54 @@ using namespace std;
 namespace {
 	// union find set && sum, firends sorted
 	vector<vector<int>> f, sum, myfriends;
-	// ans heap
-	MyHeap heap;
-	// map   myhash[tag][person] = ith
-	vector<unordered_map<int, int>> myhash;
+	// tags of person i are ptag[ptag_offset[i] ... ptag_offset[i + 1] - 1].
+	// ptag_slot of each is the index of the person in person_in_tags of
+	// that tag, which is also its union find slot.
+	// A row is sorted by (partition, tag id), and its tags of partition p
+	// are [prow[i * (nr_part + 1) + p], prow[i * (nr_part + 1) + p + 1])
+	vector<int> ptag_offset, ptag, ptag_slot, prow;
+	int nr_part;
+	// sorted by birthday, descending
+	vector<int> person;
+
+	// The union find sets of different tags never interact, so tags are
+	// split into partitions, swept in parallel on the threadpool, each over
+	// the persons having at least one of its tags and their rows of it.
+	// At every query checkpoint a partition records its own top-k, and the
+	// final answer is a k-way merge of these.
+	// In online mode the partitions sweep all persons and record the
+	// change points of each tag instead.
+	vector<vector<pair<int, int>>> events;		// (date, size), for TagTimeline
+
+	struct Q2Partition {
+		vector<int> persons;		// index into person[], increasing
+		MyHeap heap;
+		vector<vector<HeapEle>> top;		// top[i]: for the i-th query in sorted order
+		bool online;
+
+		// largest component of tag grows to s, at the birthday date
+		void update(int tag, int s, int date) {
+			if (not online) {
+				heap.change(tag, s);
+				return;
+			}
+			auto& h = events[tag];
+			if (not h.empty() && h.back().second >= s) return;
+			if (not h.empty() && h.back().first == date)
+				h.back().second = s;
+			else
+				h.emplace_back(date, s);
+		}
+	};
+	vector<int> part_of;		// partition of each tag
+
+	struct HeapEleGreater {
+		const vector<vector<HeapEle>>* lists;
+		HeapEleGreater(const vector<vector<HeapEle>>* _lists): lists(_lists) {}
+		// (list, position); the top of priority_queue is the best element
+		bool operator () (const pair<int, int>& a, const pair<int, int>& b) const
+		{ return (*lists)[b.first][b.second] < (*lists)[a.first][a.second]; }
+	};
 }
 
 bool cmp_d(int a, int b) {
@@ -29,15 +75,29 @@ bool cmp_d(int a, int b) {
 
 void Query2Handler::add_query(const Query2 &) {}
 
-vector<int> find_ans(int k) {
+// best min(k, size) elements in heap, heap unchanged
+vector<HeapEle> find_ans(MyHeap& heap, int k) {
+	vector<HeapEle> ans_now;
+	k = min(k, heap.size());
+	for (int j = 0; j < k; j++)
+		ans_now.push_back(heap.get());
+	for (int j = 0; j < k; j++) heap.insert(ans_now[j].tag_id, ans_now[j].range);
+	return ans_now;
+}
+
+// k-way merge of the per-partition answers of one query
+vector<int> merge_ans(const vector<vector<HeapEle>>& lists, int k) {
+	HeapEleGreater cmp(&lists);
+	priority_queue<pair<int, int>, vector<pair<int, int>>, HeapEleGreater> pq(cmp);
+	REP(i, lists.size())
+		if (not lists[i].empty()) pq.push(make_pair((int)i, 0));
 	vector<int> ans_now;
-	vector<HeapEle> tmp;
-	for (int j = 0; j < k; j++) {
-		tmp.push_back(heap.get());
-		ans_now.push_back(tmp.back().tag_id);
-		// print_debug("%d ", tmp.back().range);
+	while ((int)ans_now.size() < k and not pq.empty()) {
+		auto now = pq.top(); pq.pop();
+		ans_now.push_back(lists[now.first][now.second].tag_id);
+		if (now.second + 1 < (int)lists[now.first].size())
+			pq.push(make_pair(now.first, now.second + 1));
 	}
-	for (int j = 0; j < k; j++) heap.insert(tmp[j].tag_id, tmp[j].range);
 	return ans_now;
 }
 
@@ -53,81 +113,165 @@ int getf(int a, vector<int> &f) {
 	return a;
 }
 
-void Query2Handler::work() {
-	vector<vector<int>> ans;
-	f.resize(Data::ntag);
-	sum.resize(Data::ntag);
-	myfriends.resize(Data::nperson);
-	heap.resize(Data::ntag);
-	myhash.resize(Data::ntag);
-#ifdef GOOGLE_HASH
-	for (auto it = myhash.begin(); it != myhash.end(); it++)
-		it->set_empty_key(-1);
-#endif
-
-	// sort quries by d
-	sort(queries.begin(), queries.end());
-	// sort persons by d
-	vector<int> person;
-	for (int i = 0; i < Data::nperson; i++)
-		person.push_back(i);
-	sort(person.begin(), person.end(), cmp_d);
-	// sort person in tags by d
-	for (int i = 0; i < (int)Data::person_in_tags.size(); i++) {
-		sort(Data::person_in_tags[i].begin(), Data::person_in_tags[i].end(),
-				cmp_d);
-		for (int j = 0; j < (int)Data::person_in_tags[i].size(); j++)
-			myhash[i][Data::person_in_tags[i][j]] = j;
-	}
-	// sort friends by d
-	for (int i = 0; i < Data::nperson; i++) {
-		for (int j = 0; j < (int)Data::friends[i].size(); j++)
-			myfriends[i].push_back(Data::friends[i][j].pid);
-		sort(myfriends[i].begin(), myfriends[i].end(), cmp_d);
+void sweep_partition(vector<Q2Partition>* parts, int id) {
+	Q2Partition* part = &(*parts)[id];
+	MyHeap& heap = part->heap;
+	// no checkpoints in online mode
+	int nquery = part->online ? 0 : (int)queries.size();
+	if (not part->online) {
+		heap.resize(Data::ntag);
+		part->top.resize(nquery);
+		// ans heap
+		for (int i = 0; i < Data::ntag; i++)
+			if (part_of[i] == id) heap.insert(i, 0);
 	}
 
-	// ans heap
-	for (int i = 0; i < Data::ntag; i++) heap.insert(i, 0);
-
 	int queryP = 0;
-	for (int i = 0; i < Data::nperson && queryP < (int)queries.size(); i++) {
-		int person_now = person[i];
+	FOR_ITR(itr, part->persons) {
+		int person_now = person[*itr];
+		int date = Data::birthday[person_now];
 		// answer queries
-		for (; queryP < (int)queries.size() &&
-				queries[queryP].d > Data::birthday[person_now];
-				queryP++)
-			ans.push_back(find_ans(queries[queryP].k));
-		if (queryP == (int)queries.size()) break;
+		for (; queryP < nquery && queries[queryP].d > date; queryP++)
+			part->top[queryP] = find_ans(heap, queries[queryP].k);
+		if (not part->online && queryP == nquery) break;
 
 		// new person in tag
-		for (auto j = Data::tags[person_now].begin();
-				j != Data::tags[person_now].end(); j++) {
-			int tag_now = *j;
+		const int* row = &prow[(size_t)person_now * (nr_part + 1) + id];
+		int pb = row[0], pe = row[1];
+		for (int j = pb; j < pe; j++) {
+			int tag_now = ptag[j];
 			f[tag_now].push_back((int)f[tag_now].size());
 			sum[tag_now].push_back(1);
-			heap.change(tag_now, 1);
+			part->update(tag_now, 1, date);
 		}
 		for (int j = 0; j < (int)myfriends[person_now].size(); j++) {
 			int friend_now = myfriends[person_now][j];
 			if (cmp_d(person_now, friend_now)) break;
-			for (auto k = Data::tags[friend_now].begin();
-					k != Data::tags[friend_now].end(); k++) {
-				int tag_now = *k;
-				if (Data::tags[person_now].find(tag_now) ==
-						Data::tags[person_now].end())
+			// common tags of the two sorted rows of this partition
+			const int* frow = &prow[(size_t)friend_now * (nr_part + 1) + id];
+			int a = pb, b = frow[0], be = frow[1];
+			while (a < pe && b < be) {
+				if (ptag[a] != ptag[b]) {
+					if (ptag[a] < ptag[b]) a++; else b++;
 					continue;
-				int p = myhash[tag_now][friend_now];
+				}
+				int tag_now = ptag[a];
+				int p = ptag_slot[b];
+				a++, b++;
 				int set_now = getf(p, f[tag_now]);
 				if (set_now == f[tag_now][f[tag_now].size() - 1U]) continue;
 				sum[tag_now][(int)f[tag_now].size() - 1] +=
 					sum[tag_now][set_now];
 				f[tag_now][set_now] = (int)f[tag_now].size() - 1;
-				heap.change(tag_now, sum[tag_now][f[tag_now].size() - 1U]);
+				part->update(tag_now, sum[tag_now][f[tag_now].size() - 1U], date);
 			}
 		}
 	}
-	for (; queryP < (int)queries.size(); queryP++)
-		ans.push_back(find_ans(queries[queryP].k));
+	for (; queryP < nquery; queryP++)
+		part->top[queryP] = find_ans(heap, queries[queryP].k);
+	heap.free();
+}
+
+void Query2Handler::work() {
+	f.resize(Data::ntag);
+	sum.resize(Data::ntag);
+	myfriends.resize(Data::nperson);
+
+	// sort quries by d
+	sort(queries.begin(), queries.end());
+	// sort persons by d
+	person.resize(Data::nperson);
+	for (int i = 0; i < Data::nperson; i++)
+		person[i] = i;
+	sort(person.begin(), person.end(), cmp_d);
+	// flatten tags of each person
+	ptag_offset.resize(Data::nperson + 1);
+	ptag_offset[0] = 0;
+	for (int i = 0; i < Data::nperson; i++)
+		ptag_offset[i + 1] = ptag_offset[i] + (int)Data::tags[i].size();
+	ptag.resize(ptag_offset[Data::nperson]);
+	ptag_slot.resize(ptag.size());
+	for (int i = 0; i < Data::nperson; i++)
+		copy(Data::tags[i].begin(), Data::tags[i].end(), ptag.begin() + ptag_offset[i]);
+	// sort person in tags by d.
+	// tags are visited in increasing id, so each person's row fills in order
+	{
+		vector<int> cursor(ptag_offset.begin(), ptag_offset.end() - 1);
+		for (int i = 0; i < (int)Data::person_in_tags.size(); i++) {
+			sort(Data::person_in_tags[i].begin(), Data::person_in_tags[i].end(),
+					cmp_d);
+			for (int j = 0; j < (int)Data::person_in_tags[i].size(); j++)
+				ptag_slot[cursor[Data::person_in_tags[i][j]]++] = j;
+		}
+	}
+	// sort friends by d
+	for (int i = 0; i < Data::nperson; i++) {
+		myfriends[i].assign(Data::friends.pid.begin() + Data::friends.offset[i],
+				Data::friends.pid.begin() + Data::friends.offset[i + 1]);
+		sort(myfriends[i].begin(), myfriends[i].end(), cmp_d);
+	}
+
+	// assign tags to partitions, largest first to the least loaded one
+	nr_part = max(1, min(NUM_THREADS, Data::ntag));
+	vector<Q2Partition> parts(nr_part);
+	REP(i, nr_part) parts[i].online = online;
+	if (online) events.resize(Data::ntag);
+	{
+		vector<pair<int, int>> tag_size(Data::ntag);		// (-size, tag)
+		REP(i, Data::ntag)
+			tag_size[i] = make_pair(-(int)Data::person_in_tags[i].size(), (int)i);
+		sort(tag_size.begin(), tag_size.end());
+		vector<long long> load(nr_part, 0);
+		part_of.resize(Data::ntag);
+		FOR_ITR(itr, tag_size) {
+			int p = (int)(min_element(load.begin(), load.end()) - load.begin());
+			part_of[itr->second] = p;
+			load[p] += 1 - itr->first;
+		}
+		// split the rows by partition, keeping tag order inside each part
+		prow.resize((size_t)Data::nperson * (nr_part + 1));
+		vector<int> row_tag, row_slot, cursor(nr_part);
+		REP(i, Data::nperson) {
+			int* row = &prow[(size_t)i * (nr_part + 1)];
+			int pb = ptag_offset[i], pe = ptag_offset[i + 1];
+			fill(row, row + nr_part + 1, 0);
+			for (int j = pb; j < pe; j++)
+				row[part_of[ptag[j]] + 1] ++;
+			row[0] = pb;
+			REP(p, nr_part) row[p + 1] += row[p];
+			row_tag.assign(ptag.begin() + pb, ptag.begin() + pe);
+			row_slot.assign(ptag_slot.begin() + pb, ptag_slot.begin() + pe);
+			copy(row, row + nr_part, cursor.begin());
+			REP(j, row_tag.size()) {
+				int k = cursor[part_of[row_tag[j]]]++;
+				ptag[k] = row_tag[j];
+				ptag_slot[k] = row_slot[j];
+			}
+		}
+		REP(i, Data::nperson) {
+			const int* row = &prow[(size_t)person[i] * (nr_part + 1)];
+			REP(p, nr_part)
+				if (row[p] != row[p + 1])
+					parts[p].persons.push_back((int)i);
+		}
+	}
+	threadpool->parallel_for(0, nr_part,
+			bind(sweep_partition, &parts, placeholders::_1), 1);
+
+	vector<vector<int>> ans(queries.size());
+	if (online) {
+		timeline.build(events, Data::tag_name);
+		FreeAll(events);
+		REP(i, queries.size())
+			ans[i] = timeline.top_k(queries[i].k, queries[i].d);
+	} else {
+		vector<vector<HeapEle>> lists(nr_part);
+		REP(i, queries.size()) {
+			REP(p, nr_part) lists[p].swap(parts[p].top[i]);
+			ans[i] = merge_ans(lists, queries[i].k);
+		}
+	}
+	FreeAll(parts);
 
 	int nquery = (int) queries.size();
 	vector<vector<int>> final_ans(nquery);
@@ -147,16 +291,30 @@ void Query2Handler::work() {
 		continuation->cont();
 
 	// clean q2 data
-	delete[] Data::birthday;
-	FreeAll(Data::person_in_tags);
+	if (not online) {
+		delete[] Data::birthday;
+		Data::birthday = NULL;
+		FreeAll(Data::tag_rank);
+		FreeAll(Data::person_in_tags);
+	}
 	FreeAll(f);
 	FreeAll(sum);
-	FreeAll(myhash);
+	FreeAll(ptag_offset);
+	FreeAll(ptag);
+	FreeAll(ptag_slot);
+	FreeAll(prow);
 	FreeAll(myfriends);
-	heap.free();
+	FreeAll(person);
+	FreeAll(part_of);
+}
 
-	q2_finished = true;
-	q2_finished_cv.notify_all();
+vector<string> Query2Handler::answer(int k, int d) const {
+	m_assert(not timeline.empty());
+	vector<int> tags = timeline.top_k(k, d);
+	vector<string> ret;
+	ret.reserve(tags.size());
+	FOR_ITR(itr, tags) ret.emplace_back(timeline.name(*itr));
+	return ret;
 }
 
 void Query2Handler::print_result() {
@@ -7,10 +7,13 @@
 #include <string>
 #include <mutex>
 #include <map>
-#include <unordered_set>
 #include <queue>
+#include <atomic>
+#include <algorithm>
 #include "data.h"
 #include "lib/finish_time_continuation.h"
+#include "hop_ball.h"
+#include "lib/arena.h"
 
 struct Query3 {
 	int k, hop;
@@ -44,45 +47,161 @@ struct Answer3 {
 	}
 };
 
+// the best k answers seen, in a binary heap of fixed capacity k with the
+// worst one on top
+class Query3TopK {
+	public:
+		// room is reserved for at most max_size answers, k may be far larger
+		Query3TopK(int _k = 0, int max_size = 0):
+			k(_k) { h.reserve(std::max(0, std::min(k, max_size))); }
+
+		// never for k <= 0, which keeps nothing
+		bool full() const { return k > 0 && (int)h.size() == k; }
+		bool empty() const { return h.empty(); }
+		const Answer3& worst() const { return h[0]; }
+
+		// linear, only needed k times per query
+		const Answer3& best() const {
+			int ret = 0;
+			for (int i = 1; i < (int)h.size(); i ++)
+				if (h[i] < h[ret]) ret = i;
+			return h[ret];
+		}
+
+		// return whether cur is kept
+		bool insert(const Answer3& cur) {
+			if (k <= 0) return false;
+			if (full()) {
+				if (worst() < cur) return false;
+				h[0] = cur;
+				move_down(0);
+				return true;
+			}
+			h.push_back(cur);
+			move_up((int)h.size() - 1);
+			return true;
+		}
+
+		void erase(const Answer3& a) {
+			for (int i = 0; i < (int)h.size(); i ++)
+				if (h[i].p1 == a.p1 && h[i].p2 == a.p2) {
+					h[i] = h.back();
+					h.pop_back();
+					if (i < (int)h.size()) {
+						move_up(i);
+						move_down(i);
+					}
+					return;
+				}
+		}
+
+		void merge(const Query3TopK& r)
+		{ FOR_ITR(itr, r.h) insert(*itr); }
+
+	private:
+		int k;
+		std::vector<Answer3> h;
+
+		void move_up(int p) {
+			Answer3 now = h[p];
+			while (p > 0 && h[(p - 1) >> 1] < now) {
+				h[p] = h[(p - 1) >> 1];
+				p = (p - 1) >> 1;
+			}
+			h[p] = now;
+		}
+		void move_down(int p) {
+			Answer3 now = h[p];
+			int n = (int)h.size();
+			while (true) {
+				int c = p * 2 + 1;
+				if (c >= n) break;
+				if (c + 1 < n && h[c] < h[c + 1]) c ++;
+				if (! (now < h[c])) break;
+				h[p] = h[c];
+				p = c;
+			}
+			h[p] = now;
+		}
+};
+
+// people with at least this many persons are swept by several threads
+const int Q3_PARALLEL_MIN_PEOPLE = 20000;
+const int Q3_PARALLEL_CHUNK = 64;
+
 class Query3Calculator {
 	public :
 		void work(int k, int h, const std::string &p, std::vector<Answer3> &ans);
 		void calcInvertedList();
-		void moveOneStep(int g, int h, int f);
+		void moveOneStep(int g, int f, Query3TopK& heap);
 		void init(const std::string &p);
-		void insHeap(Answer3 cur, int g, int f);
+		void insHeap(Answer3 cur, int g, int f, Query3TopK& heap);
+		// first step of every person in chunks taken from next_person
+		void sweep(Query3TopK* heap);
 
-		Query3Calculator():sum(0), heapSize(0){}
+		Query3Calculator():sum(0){}
 
 	protected:
 		int sum;
-		int heapSize, qk;
-		PersonSet pset;
-		std::set<int> pinplace;
-		std::vector<int> people;
-		std::vector<Answer3> first;
-		std::map<int, int> invPeople;
-		std::set<Answer3> answerHeap;
-		std::vector<Answer3> answers;
-		std::vector<std::vector<std::vector<int> > > invList;
-		std::vector<std::vector<int>::iterator> map_itr;
-		std::vector<int> i_itr, zero_itr, curRound;
-		std::vector<unordered_map<int, int> > candidate;
-		std::vector<std::vector<std::priority_queue<int> > > pool;
-		std::vector<unordered_set<int> > forsake;
-		std::vector<std::vector<int> > invertedList;		
-//		std::vector<std::set<std::pair<int, int> > > oneHeap;
+		int qk;
+		// lower bound of the k-th com_interest, the best among all threads
+		std::atomic<int> bound;
+		std::atomic<int> next_person;
+		// sorted, g is the index in people(). shared with the place index
+		std::shared_ptr<const std::vector<int>> place_people;
+		const std::vector<int>& people() const { return *place_people; }
+		Query3TopK answerHeap;
+
+		// arrays below live in arena, released with the calculator
+		Arena arena;
+		Answer3* first;
+		int *i_itr;
+		// people having tag t: tag_people[tag_offset[t] ... tag_offset[t + 1] - 1], sorted
+		int *tag_offset, *tag_people;
+		// tags of g, fewest later people first: inv_tag[inv_offset[g] ...],
+		// inv_start is the position of g in tag_people of that tag
+		int *inv_offset, *inv_tag, *inv_start;
+
+		// candidates of g, growing by doubling in arena: the pids already
+		// taken, as an open addressing set with -1 as empty, and those
+		// waiting for a lower round, as a heap of (common tags, pid)
+		struct Candidates {
+			int *taken;
+			int nr_taken, taken_cap;
+			std::pair<int, int> *pool;
+			int nr_pool, pool_cap;
+		};
+		Candidates *cand;
+		std::mutex arena_mt;		// sweeping threads grow their candidates concurrently
+		std::shared_ptr<HopBalls> balls;		// of people
+
+		template <typename T>
+		T* alloc_shared(size_t n) {
+			std::lock_guard<std::mutex> lg(arena_mt);
+			return arena.alloc<T>(n);
+		}
+		// add pid to the taken set of g, return false if it was there
+		bool take(int g, int pid);
+		void push_pool(int g, int com_interest, int pid);
 
+		int index_of(int pid) const
+		{ return (int) (std::lower_bound(people().begin(), people().end(), pid) - people().begin()); }
 };
 
 class Query3Handler {
 	public:
 		void add_query(int k, int h, const std::string& p, int index);
 
+		// answer a single query, in server mode
+		std::vector<Answer3> answer(int k, int h, const std::string& p) const;
+
 		void work();
 
 		void print_result();		// TODO
 
+		// indexes built for Q3 only, once all queries are answered
+		static void free_index();
+
 		void bfs(int, int, int);		// for version2
 		void bfs(int, int);				// for force
 
@@ -6,6 +6,7 @@
 //			Complexity: O(N^2 * ntags * logN)
 
 #include "query3.h"
+#include "common_tags.h"
 #include <algorithm>
 #include <queue>
 #include <vector>
@@ -13,20 +14,7 @@ using namespace std;
 
 int get_common_tag(int p1, int p2)
 {
-	TagSet &t1 = Data::tags[p1], &t2 = Data::tags[p2];
-	int ret = 0;
-	TagSet::iterator it1 = t1.begin(), it2 = t2.begin();
-	while (it1 != t1.end() && it2 != t2.end())
-	{
-		if (*it1 == *it2)
-			++ret;
-		if (*it1 < *it2)
-			++it1;
-		else
-			++it2;
-	}
-	//printf("%d and %d : %d\n", p1, p2, ret);
-	return ret;
+	return common_tags(p1, p2);
 }
 
 void Query3Handler::bfs(int pid, int h)
@@ -43,8 +31,8 @@ void Query3Handler::bfs(int pid, int h)
 		{
 			int cur_id = q.front();
 			q.pop_front();
-			vector<ConnectedPerson>& friends = Data::friends[cur_id];
-			for (vector<ConnectedPerson>::iterator it = friends.begin(); it != friends.end(); ++it)
+			auto friends = Data::friends[cur_id];
+			for (auto it = friends.begin(); it != friends.end(); ++it)
 			{
 				int person = it->pid;
 				if (!vst[person])
@@ -64,6 +52,7 @@ void Query3Handler::add_query(int k, int h, const string& p) {
 	//printf("\t\t\t%s\n", p.c_str());
 	//query input
 	//init
+	PersonTags::build();
 	pset.clear();
 	answers.clear();
 	pinplace.clear();
@@ -33,7 +33,7 @@ int bfs3(int p1, int p2, int x, int h) {
 		REP(k, s1) {
 			int now_ele = q1.front();
 			q1.pop_front();
-			auto& friends = Data::friends[now_ele];
+			auto friends = Data::friends[now_ele];
 			for (auto it = friends.begin(); it != friends.end(); it ++) {
 				int person = it -> pid;
 				if (not vst1[person]) {
@@ -50,7 +50,7 @@ int bfs3(int p1, int p2, int x, int h) {
 		REP(k, s2) {
 			int now_ele = q2.front();
 			q2.pop_front();
-			auto& friends = Data::friends[now_ele];
+			auto friends = Data::friends[now_ele];
 			for (auto it = friends.begin(); it != friends.end(); it ++) {
 				int person = it -> pid;
 				if (not vst2[person]) {
@@ -98,8 +98,8 @@ void Query3Handler::bfs(int pid, int h, int k)
 		{
 			int cur_id = q.front();
 			q.pop_front();
-			vector<ConnectedPerson>& friends = Data::friends[cur_id];
-			for (vector<ConnectedPerson>::iterator it = friends.begin(); it != friends.end(); ++it)
+			auto friends = Data::friends[cur_id];
+			for (auto it = friends.begin(); it != friends.end(); ++it)
 			{
 				int person = it->pid;
 				if (!vst[person])
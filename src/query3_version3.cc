@@ -30,7 +30,7 @@ int bfs3(int p1, int p2, int x, int h) {
 		REP(k, s1) {
 			int now_ele = q1.front();
 			q1.pop_front();
-			auto& friends = Data::friends[now_ele];
+			auto friends = Data::friends[now_ele];
 			for (auto it = friends.begin(); it != friends.end(); it ++) {
 				int person = it -> pid;
 				if (it->ncmts <= x) break;
@@ -48,7 +48,7 @@ int bfs3(int p1, int p2, int x, int h) {
 		REP(k, s2) {
 			int now_ele = q2.front();
 			q2.pop_front();
-			auto& friends = Data::friends[now_ele];
+			auto friends = Data::friends[now_ele];
 			for (auto it = friends.begin(); it != friends.end(); it ++) {
 				int person = it -> pid;
 				if (it->ncmts <= x) break;
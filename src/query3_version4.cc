@@ -5,68 +5,26 @@
 #include "query3.h"
 #include "lib/common.h"
 #include "lib/Timer.h"
+#include "graph_kernel.h"
+#include "common_tags.h"
+#include "globals.h"
 #include <algorithm>
+#include <thread>
+#include <mutex>
 #include <queue>
 #include <vector>
 #include <map>
+#include <cstring>
 using namespace std;
 
-int sumbfs = 0;
+std::atomic<int> sumbfs(0);
 
 int bfs3(int p1, int p2, int x, int h) {
 	sumbfs ++;
-	if (p1 == p2) return 0;
-	vector<bool> vst1(Data::nperson, false);
-	vector<bool> vst2(Data::nperson, false);
-	deque<int> q1, q2;
-	q1.push_back(p1); vst1[p1] = true;
-	q2.push_back(p2); vst2[p2] = true;
-	int depth1 = 0, depth2 = 0;
-	while (true) {
-		size_t s1 = q1.size(), s2 = q2.size();
-		if (!s1 or !s2) break;
-
-		depth1 ++;
-		REP(k, s1) {
-			int now_ele = q1.front();
-			q1.pop_front();
-			auto& friends = Data::friends[now_ele];
-			for (auto it = friends.begin(); it != friends.end(); it ++) {
-				int person = it -> pid;
-				if (it->ncmts <= x) break;
-				if (not vst1[person]) {
-					if (vst2[person]) return depth1 + depth2;
-					q1.push_back(person);
-					vst1[person] = true;
-				}
-			}
-		}
-
-        if (depth1+depth2>=h) break;
-
-		depth2 ++;
-		REP(k, s2) {
-			int now_ele = q2.front();
-			q2.pop_front();
-			auto& friends = Data::friends[now_ele];
-			for (auto it = friends.begin(); it != friends.end(); it ++) {
-				int person = it -> pid;
-				if (it->ncmts <= x) break;
-				if (not vst2[person]) {
-					if (vst1[person]) return depth1 + depth2;
-					q2.push_back(person);
-					vst2[person] = true;
-				}
-			}
-		}
-
-        if (depth1+depth2>=h) break;
-	}
-	return 2e9;
+	int d = bidir_bfs(p1, p2, x, h);
+	return d == -1 ? (int)2e9 : d;
 }
 
-void destroy_q3_data();
-
 void Query3Handler::add_query(int k, int h, const string& p, int index) {
 	TotalTimer timer("Q3");
 
@@ -75,15 +33,23 @@ void Query3Handler::add_query(int k, int h, const string& p, int index) {
 
 	if (Data::nperson > 1e4)
 		continuation->cont();
-
-	int task_count = continuation->get_count();
-	if (!task_count) {
-		thread th(destroy_q3_data);		// clear useless data
-		th.detach();
-	}
 	return;
 }
 
+vector<Answer3> Query3Handler::answer(int k, int h, const string& p) const {
+	TotalTimer timer("Q3");
+	vector<Answer3> ret;
+	Query3Calculator calc;
+	calc.work(k, h, p, ret);
+	return ret;
+}
+
+void Query3Handler::free_index() {
+	Data::place_index.free();
+	HopBallCache::clear();
+	PersonTags::free();
+}
+
 void Query3Handler::work() { }
 
 void Query3Handler::print_result() {
@@ -100,210 +66,166 @@ void Query3Handler::print_result() {
 void Query3Calculator::init(const string &p)
 {
 	//init
-	pset.clear();
-	answers.clear();
-
-	pinplace.clear();
-	//union sets
-	FOR_ITR(it, Data::placeid[p]) {
-		PersonSet sub = Data::places[*it].get_all_persons();
-		PersonSet tmp; tmp.swap(pset);
-		pset.resize(tmp.size() + sub.size());
-		PersonSet::iterator pset_end = set_union(
-				sub.begin(), sub.end(),
-				tmp.begin(), tmp.end(), pset.begin());
-		pset.resize(std::distance(pset.begin(), pset_end));
-	}
-	if (pset.size() > 100000)
-		fprintf(stderr, "psize%lu\n", pset.size());
-
-	people.clear();
-	FOR_ITR(it1, pset)
-		people.push_back(it1->pid);
-	sort(people.begin(), people.end());		// TODO simplify this if pset is not needed
-
-	invList.resize(people.size());
-	candidate.resize(people.size());
-	i_itr.resize(people.size());
-	map_itr.resize(people.size());
-	zero_itr.resize(people.size());
-	pool.resize(people.size());
-	curRound.resize(people.size());
-	first.resize(people.size());
-//	oneHeap.resize(people.size());
-	forsake.resize(people.size());
-#ifdef GOOGLE_HASH
-	for (int i = 0; i < (int) candidate.size(); i ++)
-		candidate[i].set_empty_key(-1);
-	for (int i = 0; i < (int) forsake.size(); i ++)
-		forsake[i].set_empty_key(-1);
-#endif
+	place_people = Data::place_index.persons_of(p);		// sorted
+	if (people().size() > 100000)
+		fprintf(stderr, "psize%lu\n", people().size());
+
+	int n = (int) people().size();
+	i_itr = arena.alloc<int>(n);
+	first = arena.alloc<Answer3>(n);
+	cand = arena.alloc_zero<Candidates>(n);
 }
 
-void Query3Calculator::calcInvertedList()
+bool Query3Calculator::take(int g, int pid)
 {
-	invPeople.clear();
-	for (int g = 0; g < (int) people.size(); g ++)
-		invPeople[people[g]] = g;
-	//
-	int maxTag = 0;
-	FOR_ITR(it1, pset)
+	Candidates &c = cand[g];
+	if (2 * (c.nr_taken + 1) > c.taken_cap)
 	{
-		int curPerson = it1->pid;
-		for (TagSet::iterator i = Data::tags[curPerson].begin(); i != Data::tags[curPerson].end(); i ++)
-			maxTag = max(maxTag, (*i));
+		int cap = max(16, c.taken_cap * 2);
+		int *old = c.taken, old_cap = c.taken_cap;
+		c.taken = alloc_shared<int>(cap);
+		c.taken_cap = cap;
+		c.nr_taken = 0;
+		fill(c.taken, c.taken + cap, -1);
+		for (int i = 0; i < old_cap; i ++)
+			if (old[i] != -1)
+				take(g, old[i]);
 	}
-
-	invertedList.resize(maxTag + 10);
-
-	for (int g = (int) people.size() - 1; g >= 0; g --)
+	unsigned mask = (unsigned) c.taken_cap - 1;
+	for (unsigned h = ((unsigned) pid * 2654435761u) & mask; ; h = (h + 1) & mask)
 	{
-		TagSet curTagSet = Data::tags[people[g]];
-
-		int curPerson = people[g];
-
-		vector<pair<int, int> > curTags; curTags.clear();
-
-		//modify global inverted list
-		for (TagSet::iterator i = curTagSet.begin(); i != curTagSet.end(); i ++)
-			invertedList[*i].push_back(curPerson), curTags.push_back(make_pair(invertedList[*i].size(), (*i)));
-
-		//sort by size
-		sort(curTags.begin(), curTags.end());
-		invList[g].clear();
-
-		//generate local inverted list
-		for (int i = 0; i < (int) curTags.size(); i ++)
+		if (c.taken[h] == pid)
+			return false;
+		if (c.taken[h] == -1)
 		{
-			vector<int> r; r.clear();
-			r.push_back(curTags[i].second);
-			invList[g].push_back(r);
+			c.taken[h] = pid;
+			c.nr_taken ++;
+			return true;
 		}
 	}
+}
+
+void Query3Calculator::push_pool(int g, int com_interest, int pid)
+{
+	Candidates &c = cand[g];
+	if (c.nr_pool == c.pool_cap)
+	{
+		int cap = max(8, c.pool_cap * 2);
+		pair<int, int> *pl = alloc_shared<pair<int, int> >(cap);
+		copy(c.pool, c.pool + c.nr_pool, pl);
+		c.pool = pl;
+		c.pool_cap = cap;
+	}
+	c.pool[c.nr_pool ++] = make_pair(com_interest, pid);
+	push_heap(c.pool, c.pool + c.nr_pool);
+}
 
-	for (int i = 0; i < (int) invertedList.size(); i ++)
-		sort(invertedList[i].begin(), invertedList[i].end());
+void Query3Calculator::calcInvertedList()
+{
+	int n = (int) people().size();
+	int maxTag = -1;
+	inv_offset = arena.alloc<int>(n + 1);
+	inv_offset[0] = 0;
+	for (int g = 0; g < n; g ++)
+	{
+		const TagSet &curTagSet = Data::tags[people()[g]];
+		inv_offset[g + 1] = inv_offset[g] + (int) curTagSet.size();
+		FOR_ITR(i, curTagSet)
+			maxTag = max(maxTag, *i);
+	}
 
-	for (int g = 0; g < (int) people.size(); g ++)
+	// people of each tag, sorted since people is
+	int ntag = maxTag + 1;
+	tag_offset = arena.alloc_zero<int>(ntag + 1);
+	for (int g = 0; g < n; g ++)
+		FOR_ITR(i, Data::tags[people()[g]])
+			tag_offset[*i + 1] ++;
+	for (int t = 0; t < ntag; t ++)
+		tag_offset[t + 1] += tag_offset[t];
+	int *cnt = arena.alloc<int>(ntag);
+	memcpy(cnt, tag_offset, sizeof(int) * ntag);
+
+	// visiting g in increasing order, cnt[t] is the position of g in tag t
+	tag_people = arena.alloc<int>(tag_offset[ntag]);
+	inv_tag = arena.alloc<int>(inv_offset[n]);
+	inv_start = arena.alloc<int>(inv_offset[n]);
+	vector<pair<int, int> > cur;		// (people left in tag from g, tag)
+	for (int g = 0; g < n; g ++)
 	{
-		vector<pair<int, int> > cur; cur.clear();
-		for (int i = 0; i < (int) invList[g].size(); i ++)
-		{
-			int curTag = invList[g][i][0];
-			vector<int>::iterator it = lower_bound(invertedList[curTag].begin(), invertedList[curTag].end(), people[g]);
-			cur.push_back(make_pair((int) (invertedList[curTag].end() - it), curTag));
-		}
+		cur.clear();
+		FOR_ITR(i, Data::tags[people()[g]])
+			cur.emplace_back(tag_offset[*i + 1] - cnt[*i], *i);
 		sort(cur.begin(), cur.end());
 
 		for (int i = 0; i < (int) cur.size(); i ++)
 		{
-			invList[g][i][0] = cur[i].second;
-			invList[g][i].push_back((int) invertedList[cur[i].second].size() - cur[i].first);
+			int t = cur[i].second;
+			inv_tag[inv_offset[g] + i] = t;
+			inv_start[inv_offset[g] + i] = cnt[t];
+			tag_people[cnt[t] ++] = people()[g];
 		}
 	}
-
 }
 
-void Query3Calculator::moveOneStep(int g, int h, int f)
+void Query3Calculator::moveOneStep(int g, int f, Query3TopK& heap)
 {
-	vector<vector<int> > &r = invList[g];
-	int curPerson = people[g];
+	int curPerson = people()[g];
+	int nr = inv_offset[g + 1] - inv_offset[g];
+	Candidates &c = cand[g];
 
-	for (; i_itr[g] < (int) r.size(); i_itr[g] ++)
+	for (; i_itr[g] < nr; i_itr[g] ++)
 	{
-		sum ++;
-		int i = i_itr[g], curLen = (int) r.size() - i;
+		int i = i_itr[g], curLen = nr - i;
 		//prune
-		if (heapSize == qk)
-		{
-			set<Answer3>::iterator it = answerHeap.end();
-			it --;
-			if (it->com_interest > curLen) return ;
-		}
-
-		if (i > curRound[g])
-		{
-//			FOR_ITR(j, r[i])
-			for (int j = r[i][1]; j < (int) invertedList[r[i][0]].size(); j ++)
-				candidate[g][invertedList[r[i][0]][j]] ++;
-			curRound[g] = i;
-			map_itr[g] = r[i].begin();
-		}
+		if (heap.full() && heap.worst().com_interest > curLen)
+			return ;
+		if (bound.load(std::memory_order_relaxed) > curLen)
+			return ;
 
-		//
-		while (! pool[g][curLen].empty())
+		// candidates never share more tags than g has left
+		while (c.nr_pool > 0 && c.pool[0].first == curLen)
 		{
-			int cur = pool[g][curLen].top();
-			pool[g][curLen].pop();
-			if (bfs3(curPerson, cur, -1, h) <= h)
-				insHeap(Answer3(curLen, curPerson, cur), g, f);
+			int cur = c.pool[0].second;
+			pop_heap(c.pool, c.pool + c.nr_pool);
+			c.nr_pool --;
+			if (balls->within(g, cur))
+				insHeap(Answer3(curLen, curPerson, cur), g, f, heap);
 		}
 
-//		if (i == (int) r.size() - 1) break;
-		for (int jj = r[i][1]; jj < (int) invertedList[r[i][0]].size(); jj ++)
+		int t = inv_tag[inv_offset[g] + i];
+		for (int jj = inv_start[inv_offset[g] + i]; jj < tag_offset[t + 1]; jj ++)
 		{
-			int j = invertedList[r[i][0]][jj];
-			if (! forsake[g].count(j))
+			int j = tag_people[jj];
+			if (take(g, j))
 			{
-				forsake[g].insert(j);
-				int tot = candidate[g][j];
-				for (int p = i + 1; p < (int) r.size(); p ++)
-				{
-					int flag = 0, curTag = r[p][0];
-					for (int lo = r[p][1], hi = (int) invertedList[curTag].size() - 1; lo <= hi; )
-					{
-						int mid = (lo + hi) / 2;
-						if (invertedList[curTag][mid] == j)
-						{
-							flag = 1; break;
-						}
-						if (invertedList[curTag][mid] < j) lo = mid + 1; else hi = mid - 1;
-					}
-					if (flag) tot ++;
-				}
+				int tot = common_tags(curPerson, j);
 
-				if (tot != (int) r.size() - i)
+				if (tot != curLen)
 				{
-					pool[g][tot].push(j);
+					push_pool(g, tot, j);
 					continue;
 				}
-				if (bfs3(curPerson, j, -1, h) > h)
+				if (! balls->within(g, j))
 					continue;
-				insHeap(Answer3(curLen, curPerson, j), g, f);
-				map_itr[g] ++;
+				insHeap(Answer3(curLen, curPerson, j), g, f, heap);
 				return ;
 			}
 		}
 	}
-/*
-	while (! oneHeap[g].empty())
-	{
-		set<pair<int, int> >::iterator i = oneHeap[g].begin();
-		int cur =  i->first, bar = i->second;
-		oneHeap[g].erase(i);
-		r[bar].erase(r[bar].begin());
-		if (! r[bar].empty())
-			oneHeap[g].insert(make_pair(*(r[bar].begin()), bar));
-		if (! forsake[g].count(cur) && bfs3(curPerson, cur, -1, h) <= h)
-			forsake[g].insert(cur), insHeap(Answer3(1, curPerson, cur), g, f);
-	}
-*/
 }
 
-void Query3Calculator::insHeap(Answer3 cur, int g, int f)
+void Query3Calculator::insHeap(Answer3 cur, int g, int f, Query3TopK& heap)
 {
 //	answerHeap.insert(cur); return ;
 	if (! f)
 	{
-		if (heapSize < qk)
-			answerHeap.insert(cur), heapSize ++;
-		else
+		if (heap.insert(cur) && heap.full())
 		{
-			set<Answer3>::iterator it = answerHeap.end();
-			it --;
-			if ((*it) < cur) return ;
-			answerHeap.erase(it);
-			answerHeap.insert(cur);
+			// publish the k-th com_interest of this heap as a global bound
+			int now = heap.worst().com_interest;
+			int old = bound.load(std::memory_order_relaxed);
+			while (old < now && ! bound.compare_exchange_weak(old, now))
+				;
 		}
 		return ;
 	}
@@ -311,30 +233,58 @@ void Query3Calculator::insHeap(Answer3 cur, int g, int f)
 	return ;
 }
 
+void Query3Calculator::sweep(Query3TopK* heap)
+{
+	int n = (int) people().size();
+	while (true)
+	{
+		int b = next_person.fetch_add(Q3_PARALLEL_CHUNK);
+		if (b >= n) break;
+		for (int g = b; g < min(b + Q3_PARALLEL_CHUNK, n); g ++)
+		{
+			i_itr[g] = 0;
+			take(g, people()[g]);
+			moveOneStep(g, 0, *heap);
+		}
+	}
+}
+
 void Query3Calculator::work(int k, int h, const string &p, std::vector<Answer3> &ans)
 {
-	qk = k;
+	if (k <= 0)
+		return ;
+	PersonTags::build();
 	init(p);
+	// no more answers than pairs of people
+	long long nr_pair = (long long) people().size() * ((long long) people().size() - 1) / 2;
+	k = (int) min((long long) k, nr_pair);
+	qk = k;
 	calcInvertedList();
+	balls = HopBallCache::get(p, h);
+	if (! balls)
+		balls = make_shared<HopBalls>(place_people, h);
 	//Arsenal is the champion!!
-	answerHeap.clear();
-
-//#pragma omp parallel for schedule(dynamic)
-	for (int g = 0; g < (int) people.size(); g ++)
+	answerHeap = Query3TopK(k, (int) people().size());
+	bound = 0;
+	next_person = 0;
+
+	// persons are independent except for the heap: each thread keeps its
+	// own top k, and they share only the pruning bound
+	int nr_thread = 1;
+	if ((int) people().size() >= Q3_PARALLEL_MIN_PEOPLE)
+		nr_thread = threadpool->get_nr_idle_thread() + 1;
+	if (nr_thread == 1)
+		sweep(&answerHeap);
+	else
 	{
-		i_itr[g] = 0;
-		zero_itr[g] = g + 1;
-		curRound[g] = -1;
-
-		candidate[g].clear();
-		forsake[g].clear();
-		pool[g].resize(invList[g].size() + 2);
-		forsake[g].insert(people[g]);
-/*
-		//init oneHeap
-		for (int i = 0; i < (int) invList[g].size(); i ++)
-			oneHeap[g].insert(make_pair(*(invList[g][i].begin()), i));*/
-		moveOneStep(g, h, 0);
+		// children not started by idle workers find no person left
+		vector<Query3TopK> local(nr_thread, Query3TopK(k, (int) people().size()));
+		TaskGroup group(threadpool);
+		for (int i = 1; i < nr_thread; i ++)
+			group.run(bind(&Query3Calculator::sweep, this, &local[i]));
+		sweep(&local[0]);
+		group.wait();
+		FOR_ITR(l, local) answerHeap.merge(*l);
 	}
 //	return ;
 
@@ -344,26 +294,29 @@ void Query3Calculator::work(int k, int h, const string &p, std::vector<Answer3>
 //		if (first[i].p1 != first[i].p2)
 //			answerHeap.insert(first[i]);
 //
-	set<pair<int, int> > dup;
-	dup.clear();
+	vector<pair<int, int> > dup;		// sorted once the first loop is done
 	vector<Answer3> tmp; tmp.clear();
 
 	for (int lp = 1; lp <= k; lp ++)
 	{
 		if (answerHeap.empty()) break;
-		set<Answer3>::iterator i = answerHeap.begin();
-		tmp.push_back(*i);
-		dup.insert(make_pair(i->p1, i->p2));
-		moveOneStep(invPeople[i->p1], h, 0);
+		Answer3 i = answerHeap.best();
+		tmp.push_back(i);
+		dup.emplace_back(i.p1, i.p2);
+		moveOneStep(index_of(i.p1), 0, answerHeap);
 		answerHeap.erase(i);
-		heapSize --;
 	}
 
-	for (int i = 0; i < (int) people.size() && (int) tmp.size() < k; i ++)
-		for (int j = i + 1; j < (int) people.size() && (int) tmp.size() < k; j ++)
-			if (! dup.count(make_pair(people[i], people[j])) && bfs3(people[i], people[j], -1, h) <= h)
-				dup.insert(make_pair(people[i], people[j])), tmp.push_back(Answer3(0, people[i], people[j]));
+	// pairs below are new and increasing, no need to add them to dup
+	sort(dup.begin(), dup.end());
+	for (int i = 0; i < (int) people().size() && (int) tmp.size() < k; i ++)
+		for (int j = i + 1; j < (int) people().size() && (int) tmp.size() < k; j ++)
+			if (! binary_search(dup.begin(), dup.end(), make_pair(people()[i], people()[j])) && balls->within(i, people()[j]))
+				tmp.push_back(Answer3(0, people()[i], people()[j]));
 	// TODO count, insert
 
 	ans = move(tmp);
+	HopBallCache::put(p, h, balls);
+	balls.reset();
+	arena.release();
 }
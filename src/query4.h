@@ -8,11 +8,16 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <queue>
+#include <list>
 #include "lib/utils.h"
 #include "lib/Timer.h"
 #include "lib/hash_lib.h"
 #include "lib/finish_time_continuation.h"
+#include "lib/csr_graph.h"
+#include "lib/bfs_scratch.h"
 #include "data.h"
+#include "closeness_batch.h"
 
 struct Query4 {
 	int k;
@@ -21,10 +26,51 @@ struct Query4 {
 		k(_k), tag(s){}
 };
 
+class Query4Calculator;
+
+// Subgraph of one tag and its closeness state, shared by the queries on
+// the tag. Freed once all of them are answered.
+struct Q4TagState {
+	std::mutex mt;		// held by a query resuming the refinement
+	int refcount;		// queries on the tag not answered yet
+	int k;				// largest k among them, used to build calc
+	std::vector<int> queries;		// indices of the batch queries on the tag
+	bool built;		// friends and old_pid
+	CSRGraph friends;
+	std::vector<int> old_pid;
+	std::shared_ptr<Query4Calculator> calc;		// NULL if the tag has no person
+	size_t charged;		// memory counted by the server cache
+
+	Q4TagState(): refcount(0), k(0), built(false), charged(0) {}
+
+	// ints kept, roughly
+	size_t memory() const {
+		return friends.offset.size() + friends.adj.size() + old_pid.size() * 5 + 64;
+	}
+};
+
+// ints kept by the tag states of server mode, least recently used go first
+const size_t Q4_STATE_CACHE_SIZE = 1 << 25;
+
 class Query4Handler {
 	public:
+		Query4Handler();
+
+		// group the queries by tag, before any add_query
+		void prepare_tags(const std::vector<Query4>& qs);
+
 		void add_query(int k, const std::string& s, int index);
 
+		// answer all queries on the threadpool: the state of every tag is
+		// built by one task, which then starts the queries on the tag.
+		// return once all of them are answered
+		void add_queries(const std::vector<Query4>& qs);
+
+		// answer a single query on any tag, in server mode: the state of a
+		// tag is built by its first query and kept for the later ones,
+		// within Q4_STATE_CACHE_SIZE
+		std::vector<int> answer(int k, const std::string& s);
+
 		void work();
 
 		void print_result();		// TODO
@@ -32,21 +78,45 @@ class Query4Handler {
 		std::vector<std::vector<int>> ans;	// must be resized correctly
 
 		std::shared_ptr<FinishTimeContinuation> continuation;
+
+	protected:
+		// not modified after prepare_tags
+		unordered_map<std::string, std::shared_ptr<Q4TagState>, StringHashFunc> tag_state;
+
+		// states of server mode, most recently used first, under tag_mt.
+		// an evicted state lives on until its running queries are done
+		typedef std::pair<std::string, std::shared_ptr<Q4TagState>> CachedState;
+		std::list<CachedState> cached_state;
+		size_t cached_size;
+		std::mutex tag_mt;
+
+		TaskGroup* tasks;		// of the running add_queries
+
+		// subgraph of the persons of tag s
+		void build_graph(const std::string& s, Q4TagState& st);
+		// estimation on the built subgraph, for queries up to st.k
+		void prepare_calc(Q4TagState& st);
+		// build the state of tag s, then start its queries in tasks
+		void run_tag(const std::vector<Query4>* qs, std::string s);
+		// best k persons of the tag, st built and st.mt held
+		std::vector<int> top(Q4TagState& st, int k);
 };
 
 
 class Query4Calculator {
 	public:
 		size_t np;
-		const std::vector<std::vector<int>>& friends;
+		const CSRGraph& friends;
 		int k;
 
 		int contract_dist;
 		int contract_nr_vtx;
 
-		Query4Calculator(const std::vector<std::vector<int>>& _friends,
+		Query4Calculator(const CSRGraph& _friends,
 				int _k):
-			np(_friends.size()), friends(_friends), k(_k) {
+			np(_friends.size()), friends(_friends), k(_k), prepared(false),
+			last_centrality(1e100), last_vtx(-1), cnt(0),
+			sum_bound((int)1e9), est_depth(0), est_cutcnt(0) {
 
 				degree = new int[np];
 				estimated_s.resize(np);
@@ -55,7 +125,16 @@ class Query4Calculator {
 				compute_degree();
 			}
 
-		std::vector<int> work();
+		// estimate all s, only once
+		void prepare();
+
+		// best k vertices, resuming the refinement of previous calls
+		std::vector<int> top(int k);
+
+		std::vector<int> work() {
+			prepare();
+			return top(k);
+		}
 
 
 		~Query4Calculator() {
@@ -64,12 +143,39 @@ class Query4Calculator {
 
 
 	protected:
+		struct HeapEle {
+			int vtx;
+			double centrality;
+
+			HeapEle() {}
+			HeapEle(int _vtx, double _centrality) :
+				vtx(_vtx), centrality(_centrality)
+			{ }
+
+			bool operator < (const HeapEle& r) const
+			{
+				if (centrality == r.centrality)
+					return vtx > r.vtx;
+				return centrality < r.centrality;
+			}
+		};
+
 		int* degree;
 		std::vector<int> estimated_s;
 		std::vector<int> exact_s;
 
+		// state of the refinement, kept between calls of top()
+		bool prepared;
+		std::priority_queue<HeapEle> q;
+		std::vector<int> ans;		// verified, best first
+		double last_centrality;
+		int last_vtx;
+		int cnt;		// exact s computed while refining
+		int sum_bound, est_depth, est_cutcnt;
+		Timer timer;
+
 		void compute_degree() {
-			std::vector<size_t> que(np);
+			std::vector<int> que(np);
 			REP(i, np)
 				degree[i] = -1;
 
@@ -78,9 +184,9 @@ class Query4Calculator {
 					continue;
 				degree[i] = 1;
 				int qh = 0, qt = 1;
-				que[qh] = i;
+				que[qh] = (int)i;
 				while (qh != qt) {
-					size_t v0 = que[qh ++];
+					int v0 = que[qh ++];
 					FOR_ITR(itr, friends[v0]) {
 						auto& v1 = *itr;
 						if (degree[v1] != -1)
@@ -99,28 +205,42 @@ class Query4Calculator {
 			if (exact_s[source] != -1)
 				return exact_s[source];
 
-			std::vector<bool> hash(np);
-			std::queue<int> q;
-			hash[source] = true;
+			BFSScratch& bs = BFSScratch::local();
+			bs.start(np);
+			auto& q = bs.queue;
+			bs.visited.set(source);
 			q.push(source);
 			int s = 0;
 			for (int depth = 0; !q.empty(); depth ++) {
 				int qsize = (int)q.size();
+				s += depth * qsize;
 				for (int i = 0; i < qsize; i ++) {
-					int v0 = q.front(); q.pop();
-					s += depth;
-					FOR_ITR(v1, friends[v0]) {
-						if (hash[*v1])
-							continue;
-						hash[*v1] = true;
-						q.push(*v1);
-					}
+					int v0 = q.pop();
+					FOR_ITR(v1, friends[v0])
+						if (bs.visited.test_and_set(*v1))
+							q.push(*v1);
 				}
 			}
 			exact_s[source] = s;
 			return s;
 		}
 
+		// compute exact_s of the vertices not known yet in batches
+		void prefetch_exact_s(const std::vector<int>& vtx) {
+			std::vector<int> todo;
+			FOR_ITR(itr, vtx)
+				if (exact_s[*itr] == -1) {
+					exact_s[*itr] = 0;		// no duplicate in todo
+					todo.emplace_back(*itr);
+				}
+			if (todo.empty())
+				return;
+			std::vector<int> s(todo.size());
+			batch_exact_s(friends, todo.data(), (int)todo.size(), s.data());
+			REP(i, todo.size())
+				exact_s[todo[i]] = s[i];
+		}
+
 		double get_centrality_by_vtx_and_s(int v, int s) {
 			if (s == 0)
 				return 0;
@@ -130,7 +250,7 @@ class Query4Calculator {
 
 		int estimate_s_limit_depth(int source, int depth_max);
 		int estimate_s_limit_depth_cut_upper(int source, int depth_max, double upper);
-		void bfs_diameter(const std::vector<std::vector<int>> &g, int source, int &farthest_vtx,
+		void bfs_diameter(const CSRGraph&g, int source, int &farthest_vtx,
 				int &dist_max, std::vector<bool> &hash);
 
 
@@ -140,7 +260,7 @@ class Query4Calculator {
 
 		//! change_vtx is a vector of pair (vtx, dist)
 		//! return number of vertex traversed
-		int bfs(const std::vector<std::vector<int>> &graph,
+		int bfs(const CSRGraph&graph,
 				int source, int base_dist, int est_dist_max, std::vector<int> &dist,
 				std::vector<int> &dist_count,
 				std::vector<std::pair<int, int>> *changed_vtx = NULL);
@@ -158,9 +278,9 @@ class Query4Calculator {
 
 
 		//! A scheduler returns a ScheduleNode, which is the
-		typedef std::function<std::shared_ptr<ScheduleNode>(const std::vector<std::vector<int>> &)> scheduler_t;
+		typedef std::function<std::shared_ptr<ScheduleNode>(const CSRGraph&)> scheduler_t;
 
-		static std::shared_ptr<ScheduleNode> scheduler_bfs(const std::vector<std::vector<int>> &graph);
+		static std::shared_ptr<ScheduleNode> scheduler_bfs(const CSRGraph&graph);
 
 		typedef std::priority_queue<std::pair<double, int>> TopKList;
 
@@ -86,7 +86,7 @@ void Query4Handler::add_query(int k, const string& s) {
 	friends.resize(np);
 	REP(i, np) {
 		friends[i].clear();
-		auto& fs = Data::friends[persons[i]];
+		auto fs = Data::friends[persons[i]];
 		for (auto itr = fs.begin(); itr != fs.end(); itr ++) {
 			auto lb_itr = lower_bound(persons.begin(), persons.end(), itr->pid);
 			if (*lb_itr == itr->pid) {
@@ -238,7 +238,7 @@ void Query4Handler::add_query(int k, const string& s, int index) {
 		GuardedTimer timer("omp1");
 #pragma omp parallel for schedule(static) num_threads(4)
 		REP(i, np) {
-			auto& fs = Data::friends[persons[i]];
+			auto fs = Data::friends[persons[i]];
 			FOR_ITR(itr, fs) {
 				auto lb_itr = lower_bound(persons.begin(), persons.end(), itr->pid);
 				if (lb_itr != persons.end() and *lb_itr == itr->pid) {
@@ -10,7 +10,6 @@
 #include "SumEstimator.h"
 //#include "search_depth_estimator.h"
 #include "lib/hash_lib.h"
-#include <omp.h>
 #include <queue>
 #include <algorithm>
 #include <set>
@@ -28,27 +27,7 @@
 
 using namespace std;
 
-namespace {
-	struct HeapEle {
-		int vtx;
-		double centrality;
-
-		HeapEle() {}
-		HeapEle(int _vtx, double _centrality) :
-			vtx(_vtx), centrality(_centrality)
-		{ }
-
-		bool operator < (const HeapEle& r) const
-		{
-			if (centrality == r.centrality)
-				return vtx > r.vtx;
-			return centrality < r.centrality;
-		}
-	};
-}
-
-
-void Query4Calculator::bfs_diameter(const std::vector<vector<int>> &g, int source, int &farthest_vtx,
+void Query4Calculator::bfs_diameter(const CSRGraph&g, int source, int &farthest_vtx,
 		int &dist_max, vector<bool> &hash) {
 	queue<int> q;
 	q.push(source);
@@ -71,9 +50,11 @@ void Query4Calculator::bfs_diameter(const std::vector<vector<int>> &g, int sourc
 	}
 }
 
-vector<int> Query4Calculator::work() {
+void Query4Calculator::prepare() {
+	if (prepared)
+		return;
+	prepared = true;
 	TotalTimer ttt("q4calculator");
-	Timer timer;
 
 	const bool use_estimate = (np > 10000 && k < 20);
 
@@ -83,7 +64,6 @@ vector<int> Query4Calculator::work() {
 	//int thres = (int)((double)np * 0.31);		// 0.51 is ratio to keep
 	int thres = np;
 	vector<PII> approx_result_with_person; approx_result_with_person.reserve(np);
-	int sum_bound = 1e9;
 	std::vector<int> wrong_result;
 	{
 		TotalTimer tttt("estimate random");
@@ -113,6 +93,13 @@ vector<int> Query4Calculator::work() {
 			int nr_sample = 2 * k;// can be x * k
 			FOR_ITR(itr, approx_result_with_person) {
 				int pid = itr->second;
+				if (exact_s[pid] == -1) {
+					vector<int> batch;
+					for (auto b = itr; b != approx_result_with_person.end() &&
+							(int)batch.size() < CLOSENESS_BATCH; ++b)
+						batch.emplace_back(b->second);
+					prefetch_exact_s(batch);
+				}
 				int s = get_exact_s(pid);
 
 				s_calculated.push_back(pid);
@@ -148,6 +135,8 @@ vector<int> Query4Calculator::work() {
 	estimator.init();
 
 	estimated_s = move(estimator.result);
+	est_depth = estimator.depth;
+	est_cutcnt = estimator.cutcnt;
 
 	if (use_estimate) {
 		REPL(i, thres, (int)np)
@@ -164,16 +153,15 @@ vector<int> Query4Calculator::work() {
 		heap_ele_buf.emplace_back(i, centrality);
 	}
 
-	priority_queue<HeapEle> q(heap_ele_buf.begin(), heap_ele_buf.end());
+	q = priority_queue<HeapEle>(heap_ele_buf.begin(), heap_ele_buf.end());
+}
 
+vector<int> Query4Calculator::top(int k) {
+	m_assert(prepared);
 	// iterate
-	vector<int> ans;
-	int cnt = 0;
-	{
+	if ((int)ans.size() < k) {
 		DEBUG_DECL(TotalTimer, ttt("iterate q4 heap"));		// about 6% of total q4 time
 		DEBUG_DECL(GuardedTimer, tttt(string_format("np: %d iterate q4 heap", np).c_str()));
-		double last_centrality = 1e100;
-		int last_vtx = -1;
 		while (!q.empty()) {
 			auto he = q.top(); q.pop();
 			int vtx = he.vtx;
@@ -186,6 +174,17 @@ vector<int> Query4Calculator::work() {
 				}
 			} else {
 				cnt ++;
+				if (exact_s[vtx] == -1) {
+					// the candidates right below are likely to be verified next
+					vector<HeapEle> next;
+					vector<int> batch(1, vtx);
+					while (!q.empty() && (int)batch.size() < CLOSENESS_BATCH) {
+						next.emplace_back(q.top()); q.pop();
+						batch.emplace_back(next.back().vtx);
+					}
+					prefetch_exact_s(batch);
+					FOR_ITR(itr, next) q.push(*itr);
+				}
 				int s = get_exact_s(vtx);
 				// int es = estimated_s[vtx];
 				double new_centrality = get_centrality_by_vtx_and_s(vtx, s);
@@ -204,66 +203,187 @@ vector<int> Query4Calculator::work() {
 
 #endif
 			fprintf(stderr, "%lu/%d/%dd%d:%.4lf\n", np, cnt, k,
-					estimator.depth, timer.get_time());
+					est_depth, timer.get_time());
 			fflush(stderr);
 #ifndef DEBUG
 		}
 #endif
-		if (estimator.cutcnt > 1000)
+		if (est_cutcnt > 1000)
 			fprintf(stderr, "cut%d~%d~%d/%d\n", exact_s[ans.front()], exact_s[ans.back()],
-					sum_bound, estimator.cutcnt);
+					sum_bound, est_cutcnt);
 		print ++;
 	}
-	return move(ans);
+	return vector<int>(ans.begin(), ans.begin() + min(k, (int)ans.size()));
 }
 
 
-void Query4Handler::add_query(int k, const string& s, int index) {
-	TotalTimer timer("Q4");
-	// build graph
+Query4Handler::Query4Handler(): cached_size(0), tasks(NULL) {
+#ifdef GOOGLE_HASH
+	tag_state.set_empty_key("");
+#endif
+}
+
+void Query4Handler::prepare_tags(const vector<Query4>& qs) {
+	REP(i, qs.size()) {
+		auto& st = tag_state[qs[i].tag];
+		if (not st)
+			st = make_shared<Q4TagState>();
+		st->refcount ++;
+		st->k = max(st->k, qs[i].k);
+		st->queries.emplace_back((int)i);
+	}
+}
+
+void Query4Handler::add_queries(const vector<Query4>& qs) {
+	prepare_tags(qs);
+	TaskGroup group(threadpool, 10);
+	tasks = &group;
+	FOR_ITR(itr, tag_state)
+		group.run(bind(&Query4Handler::run_tag, this, &qs, itr->first));
+	group.wait();
+	tasks = NULL;
+}
+
+void Query4Handler::run_tag(const vector<Query4>* qs, string s) {
+	Q4TagState& st = *tag_state.find(s)->second;
+	// no query of the tag runs yet, so no lock. they only wait on each
+	// other for the refinement of top(k)
+	build_graph(s, st);
+	prepare_calc(st);
+	FOR_ITR(itr, st.queries)
+		tasks->run(bind(&Query4Handler::add_query, this, (*qs)[*itr].k, s, *itr));
+}
+
+void Query4Handler::build_graph(const string& s, Q4TagState& st) {
+	TotalTimer tt("build graph q4");
+	st.built = true;
 	vector<bool> persons = get_tag_persons_hash(s);
 
 	size_t np = 0;
-	vector<vector<int>> friends;
-	vector<int> old_pid;
+	CSRGraph& friends = st.friends;
+	vector<int>& old_pid = st.old_pid;
+	vector<int> new_pid(Data::nperson);
+	REP(i, Data::nperson) {
+		if (persons[i]) {
+			new_pid[i] = (int)np;
+			old_pid.push_back(i);
+			np ++;
+		}
+	}
+	friends.offset.reserve(np + 1);
+	REP(i, Data::nperson) {
+		if (not persons[i]) continue;
+		friends.add_vertex();
+		auto fs = Data::friends[i];
+		FOR_ITR(itr, fs) {
+			int pid = itr->pid;
+			if (persons[pid])
+				friends.push_back(new_pid[pid]);
+		}
+	}
+}
+
+void Query4Handler::add_query(int k, const string& s, int index) {
+	TotalTimer timer("Q4");
+	auto itr = tag_state.find(s);
+	m_assert(itr != tag_state.end());
+	Q4TagState& st = *itr->second;
 
 	{
-		TotalTimer tt("build graph q4");
-		vector<int> new_pid(Data::nperson);
-		REP(i, Data::nperson) {
-			if (persons[i]) {
-				new_pid[i] = (int)np;
-				old_pid.push_back(i);
-				np ++;
-			}
+		// queries on the same tag share the graph and the refinement,
+		// built for the largest k on the tag: each one resumes from where
+		// the previous stopped
+		lock_guard<mutex> lg(st.mt);
+		if (not st.built) {		// not started by run_tag
+			build_graph(s, st);
+			prepare_calc(st);
 		}
-		friends.resize(np);
-//#pragma omp parallel for schedule(dynamic) num_threads(2)
-		REP(i, Data::nperson) {
-			if (not persons[i]) continue;
-			auto &fs = Data::friends[i];
-			FOR_ITR(itr, fs) {
-				int pid = itr->pid;
-				if (persons[pid])
-					friends[new_pid[i]].push_back(new_pid[pid]);
-			}
+		ans[index] = top(st, k);
+		fprintf(stderr, "fnp%lu\n", st.friends.size());fflush(stderr);
+
+		if (-- st.refcount == 0) {
+			st.calc.reset();
+			FreeAll(st.friends.offset);
+			FreeAll(st.friends.adj);
+			FreeAll(st.old_pid);
 		}
 	}
-	fprintf(stderr, "np%d\n", np);fflush(stderr);
-	// finish building graph
-
-	Query4Calculator worker(friends, k);
-	auto now_ans = worker.work();
-	FOR_ITR(itr, now_ans)
-		*itr = old_pid[*itr];
-	ans[index] = move(now_ans);
-	fprintf(stderr, "fnp%d\n", np);fflush(stderr);
 
 	if (Data::nperson > 1e4)
 		continuation->cont();
 }
 
 
+void Query4Handler::prepare_calc(Q4TagState& st) {
+	fprintf(stderr, "np%lu\n", st.friends.size());fflush(stderr);
+	if (st.friends.size() != 0) {		// else no such tag
+		st.calc = make_shared<Query4Calculator>(st.friends, st.k);
+		st.calc->prepare();
+	}
+}
+
+vector<int> Query4Handler::top(Q4TagState& st, int k) {
+	if (not st.calc)
+		return vector<int>();
+	auto ret = st.calc->top(k);
+	FOR_ITR(itr, ret)
+		*itr = st.old_pid[*itr];
+	return ret;
+}
+
+vector<int> Query4Handler::answer(int k, const string& s) {
+	shared_ptr<Q4TagState> st;
+	{
+		lock_guard<mutex> lg(tag_mt);
+		FOR_ITR(itr, cached_state) if (itr->first == s) {
+			st = itr->second;
+			cached_state.splice(cached_state.begin(), cached_state, itr);
+			break;
+		}
+		if (not st) {
+			st = make_shared<Q4TagState>();
+			cached_state.emplace_front(s, st);
+		}
+	}
+
+	vector<int> ret;
+	size_t memory;
+	{
+		lock_guard<mutex> lg(st->mt);
+		if (not st->built) {
+			st->k = k;
+			build_graph(s, *st);
+			prepare_calc(*st);
+		} else if (k > st->k) {
+			// the estimation only keeps enough candidates for its own k,
+			// while the subgraph does not depend on k
+			st->k = k;
+			st->calc.reset();
+			prepare_calc(*st);
+		}
+		ret = top(*st, k);
+		memory = st->memory();
+	}
+
+	lock_guard<mutex> lg(tag_mt);
+	bool cached = false;
+	FOR_ITR(itr, cached_state) if (itr->second == st) {
+		cached = true;
+		break;
+	}
+	if (not cached)		// evicted meanwhile
+		return ret;
+	cached_size += memory;
+	cached_size -= st->charged;
+	st->charged = memory;
+	// the state just used is at the front, and always kept
+	while (cached_size > Q4_STATE_CACHE_SIZE and cached_state.size() > 1) {
+		cached_size -= cached_state.back().second->charged;
+		cached_state.pop_back();
+	}
+	return ret;
+}
+
 void Query4Handler::work() { }
 void Query4Handler::print_result() {
 	FOR_ITR(itr, ans) {
@@ -3,6 +3,7 @@
 
 
 #include <stdlib.h>
+#include <cstring>
 #include <algorithm>
 #include <mutex>
 #include <cstdio>
@@ -21,82 +22,79 @@
 #include "read.h"
 #include "cache.h"
 #include "data.h"
+#include "snapshot.h"
 #include "lib/fast_read.h"
+#include "lib/csv_tokenizer.h"
 using namespace std;
 
 void read_person_file(const string& dir) {
-	static char buffer[BUFFER_LEN];
-	char *ptr, *buf_end;
-	char tmpBuf[1024];
-
-	safe_open(dir + "/person.csv");
-	ptr = buffer, buf_end = ptr + 1;
+	MMapFile file(dir + "/person.csv");
 
-	READ_TILL_EOL();
 	int pid, maxid = 0;
-	while (true) {
-		READ_INT(pid);
-		if (buf_end == buffer) break;
-		update_max(maxid, pid);
-		READ_TILL_EOL();
+	{
+		CSVTokenizer tk(file.begin(), file.end());
+		tk.skip_line();
+		while (tk.next_row(&pid, 1))
+			update_max(maxid, pid);
 	}
 	Data::nperson = maxid + 1;
 	Data::allocate();
 
 	// read birthday
-	rewind(fin);
-	ptr = buffer, buf_end = ptr + 1;
-
-	READ_TILL_EOL();
-	int year, month, day;
-	while (true) {
-		READ_INT(pid);
-		if (buffer == buf_end) break;
-		PTR_NEXT();
-		READ_STR(tmpBuf); PTR_NEXT();
-		READ_STR(tmpBuf); PTR_NEXT();
-		READ_STR(tmpBuf);
-		READ_INT(year);PTR_NEXT();
-		READ_INT(month);PTR_NEXT();
-		READ_INT(day);
-		READ_TILL_EOL();
+	CSVTokenizer tk(file.begin(), file.end());
+	tk.skip_line();
+	const char *b, *e;
+	while (not tk.eof()) {
+		pid = tk.next_int();
+		tk.next_field(b, e);		// firstName
+		tk.next_field(b, e);		// lastName
+		tk.next_field(b, e);		// gender
+		tk.next_field(b, e);		// birthday, yyyy-mm-dd
+		int year = (int)tk.to_ull(b, b + 4),
+			month = (int)tk.to_ull(b + 5, b + 7),
+			day = (int)tk.to_ull(b + 8, b + 10);
+		tk.skip_line();
 		Data::birthday[pid] = year * 10000 + month * 100 + day;
 	}
-	fclose(fin);
+	snapshot_save_persons();
 }
 
 void build_friends_hash() {
 	REP(i, Data::nperson) {
-		auto &f = Data::friends[i];
+		auto f = Data::friends[i];
 		FOR_ITR(ff, f)
 			Data::friends_hash[i].insert(ff->pid);
 	}
-	friends_hash_built = true;
-	friends_hash_built_cv.notify_all();
 	print_debug("Friends hash built\n");
 }
 
 void read_person_knows_person(const string& dir) {
-	static char buffer[BUFFER_LEN];
-	char *ptr, *buf_end;
+	MMapFile file(dir + "/person_knows_person.csv");
+	auto& g = Data::friends;
+	int p[2];
 
-	safe_open(dir + "/person_knows_person.csv");
-	ptr = buffer, buf_end = ptr + 1;
-
-	READ_TILL_EOL();
-	int p1, p2;
-	while (true) {
-		READ_INT(p1);
-		if (buffer == buf_end) break;
-		READ_INT(p2);
-		PTR_NEXT();
-		Data::friends[p1].emplace_back(p2, 0);
+	// count degrees, then fill each row in a second pass
+	g.offset.assign(Data::nperson + 1, 0);
+	{
+		CSVTokenizer tk(file.begin(), file.end());
+		tk.skip_line();
+		while (tk.next_row(p, 2))
+			g.offset[p[0] + 1] ++;
 	}
 	REP(i, Data::nperson)
-		sort(Data::friends[i].begin(), Data::friends[i].end());		// sort by id!
-	thread t(build_friends_hash);
-	t.detach();
-	fclose(fin);
+		g.offset[i + 1] += g.offset[i];
+
+	vector<int> pos(g.offset.begin(), g.offset.end() - 1);
+	g.pid.resize(g.offset.back());
+	g.ncmts.assign(g.offset.back(), 0);
+	{
+		CSVTokenizer tk(file.begin(), file.end());
+		tk.skip_line();
+		while (tk.next_row(p, 2))
+			g.pid[pos[p[0]] ++] = p[1];
+	}
+	REP(i, Data::nperson)		// sort by id!
+		sort(g.pid.begin() + g.offset[i], g.pid.begin() + g.offset[i + 1]);
 }
 
 void read_comments(const string &dir) {
@@ -224,7 +222,7 @@ void read_comments(const string &dir) {
 	// omp likely to crash?
 	//#pragma omp parallel for schedule(static) num_threads(4)
 	REP(i, Data::nperson) {
-		auto& fs = Data::friends[i];
+		auto fs = Data::friends[i];
 		auto& m = comment_map[i];
 		FOR_ITR(itr, fs) {
 			itr->ncmts = min(m[itr->pid], comment_map[itr->pid][i]);
@@ -276,7 +274,7 @@ void read_comments_2file(const string& dir) {
 	fclose(fp_p);fclose(fp_c);
 
 	REP(i, Data::nperson) {
-		auto& fs = Data::friends[i];
+		auto fs = Data::friends[i];
 		auto& m = comment_map[i];
 		FOR_ITR(itr, fs) {
 			itr->ncmts = min(m[itr->pid], comment_map[itr->pid][i]);
@@ -286,27 +284,45 @@ void read_comments_2file(const string& dir) {
 	print_debug("Read comment spent %lf secs\n", timer.get_time());
 }
 
-void destroy_tag_name();
-void read_forum(const string& dir, unordered_map<int, int>& id_map, const unordered_set<int>& q4_tag_ids) {
-	static char buffer[BUFFER_LEN];
+namespace {
+	// from read_tags to read_forums
+	unordered_map<int, int> tag_id_map;		// map from real id to continuous id
+	unordered_set<int> q4_tag_ids;			// tag id (real id) used in q4
+}
+
+void read_forums(const string& dir) {
+	unordered_map<int, int>& id_map = tag_id_map;
 	Timer timer;
-	char* ptr, *buf_end;
 	int fid, tid, pid;
 	unordered_map<int, vector<int>> forum_to_tags;		// fid -> continuous tids
+	// every forum with its tags and members, for the snapshot and server mode
+	const bool save = snapshot_collecting();
+	const bool collect = save or server_mode;
+	unordered_map<int, int> forum_index;		// fid -> index in forum_tags
+	vector<vector<int>> forum_tags, forum_members;
 #ifdef GOOGLE_HASH
 	forum_to_tags.set_empty_key(-1);
+	forum_index.set_empty_key(-1);
 #endif
 	{
 		GuardedTimer timer("read forum_hasTag_tag");
-		safe_open(dir + "/forum_hasTag_tag.csv");
-		ptr = buffer, buf_end = ptr + 1;
-		READ_TILL_EOL();
+		MMapFile file(dir + "/forum_hasTag_tag.csv");
+		CSVTokenizer tk(file.begin(), file.end());
+		tk.skip_line();
 
 		int last_fid = -1; vector<int>* last_ptr = NULL;
-		while (true) {
-			READ_INT(fid);
-			if (buffer == buf_end) break;
-			READ_INT(tid);
+		int row[2];
+		while (tk.next_row(row, 2)) {
+			fid = row[0], tid = row[1];
+
+			if (collect) {
+				auto itr = forum_index.find(fid);
+				if (itr == forum_index.end()) {
+					itr = forum_index.insert(make_pair(fid, (int)forum_tags.size())).first;
+					forum_tags.emplace_back();
+				}
+				forum_tags[itr->second].emplace_back(id_map[tid]);
+			}
 
 			if (not q4_tag_ids.count(tid))
 				continue;
@@ -324,99 +340,81 @@ void read_forum(const string& dir, unordered_map<int, int>& id_map, const unorde
 
 			last_fid = fid;
 		}
-		fclose(fin);
 	}
 	PP(forum_to_tags.size());
+	forum_members.resize(forum_tags.size());
 
 	{
 		GuardedTimer timer("read forum_hasMember_person");
 
-		// using mmap
-		int fd = open((dir + "/forum_hasMember_person.csv").c_str(), O_RDONLY);
-		struct stat s; fstat(fd, &s);
-		size_t size = s.st_size;
-		void* mapped = mmap(0, size, PROT_READ, MAP_FILE|MAP_PRIVATE, fd, 0);
-//		madvise(mapped, size, MADV_WILLNEED);
-		madvise(mapped, size, MADV_SEQUENTIAL);
-
-		ptr = (char*)mapped;
-		buf_end = (char*)mapped + size;
-
-		MMAP_READ_TILL_EOL();
+		MMapFile file(dir + "/forum_hasMember_person.csv");
+		CSVTokenizer tk(file.begin(), file.end());
+		tk.skip_line();
 
 		int last_fid = -1;
 		bool last_skip = false;
 		vector<vector<bool>*> hashes;
-		do {
-			fid = 0;
-			do {
-				fid = fid * 10 + *ptr - '0';
-				ptr ++;
-			} while (*ptr != '|');
-			ptr ++;
-			// read fid done
+		vector<int>* members = NULL;
+		while (not tk.eof()) {
+			fid = tk.next_int();
 
 			if (fid != last_fid) {
 				last_fid = fid;
-				auto itr = forum_to_tags.find(fid);
-				if (itr == forum_to_tags.end()) {
-					last_skip = true;
-					MMAP_READ_TILL_EOL();
-					continue;
-				}
-				last_skip = false;
 				hashes.clear();
-				FOR_ITR(titr, itr->second)
-					hashes.emplace_back(&q4_persons[Data::tag_name[*titr]]);
-			} else {
-				if (last_skip) {
-					MMAP_READ_TILL_EOL();
-					continue;
+				auto itr = forum_to_tags.find(fid);
+				if (itr != forum_to_tags.end())
+					FOR_ITR(titr, itr->second)
+						hashes.emplace_back(&q4_persons[Data::tag_name[*titr]]);
+				members = NULL;
+				if (collect) {
+					auto fitr = forum_index.find(fid);
+					if (fitr != forum_index.end())
+						members = &forum_members[fitr->second];
 				}
+				last_skip = hashes.empty() and members == NULL;
+			}
+			if (last_skip) {
+				tk.skip_line();
+				continue;
 			}
 
-			pid = 0;
-			do {
-				pid = pid * 10 + *ptr - '0';
-				ptr ++;
-			} while (*ptr != '|');
+			pid = tk.next_int();
+			tk.skip_line();
 
 			FOR_ITR(hs, hashes)
 				(*(*hs))[pid] = true;
-
-			MMAP_READ_TILL_EOL();
-		} while (ptr != buf_end);
-		munmap(mapped, size);
-		close(fd);
+			if (members)
+				members->emplace_back(pid);
+		}
 	}
+	if (save)
+		snapshot_save_forums(forum_tags, forum_members);
+	if (server_mode)
+		Data::set_forums(forum_tags, forum_members);
 
-	thread th(destroy_tag_name);
-	th.detach();
+	tag_id_map = unordered_map<int, int>();
+	q4_tag_ids = unordered_set<int>();
 
 	print_debug("Read forum spent %lf secs\n", timer.get_time());
 }
 
 
-void read_tags_forums_places(const string& dir) {
-	char buffer[1024];
+void read_tags(const string& dir) {
 	Timer timer;
 
-	unordered_map<int, int> id_map; // map from real id to continuous id
-	unordered_set<int> q4_tag_ids;	// tag id (real id) used in q4
+	unordered_map<int, int>& id_map = tag_id_map;
 #ifdef GOOGLE_HASH
 	q4_tag_ids.set_empty_key(-1);
 	id_map.set_empty_key(-1);
 #endif
-	int tid, pid;
 	{		// read tag and tag names
-		safe_open(dir + "/tag.csv");
-		fgets(buffer, 1024, fin);
-		string tag_name;
-		while (fscanf(fin, "%d|", &tid) == 1) {
-			char c;
-			tag_name.clear();
-			while ((c = (char)fgetc(fin)) != '|')
-				tag_name += c;
+		MMapFile file(dir + "/tag.csv");
+		CSVTokenizer tk(file.begin(), file.end());
+		tk.skip_line();
+		while (not tk.eof()) {
+			int tid = tk.next_int();
+			string tag_name = tk.next_str();
+			tk.skip_line();
 			id_map[tid] = (int)Data::tag_name.size();
 
 			if (q4_tag_set.count(tag_name))		// cache all q4 tid (real tid)
@@ -425,10 +423,9 @@ void read_tags_forums_places(const string& dir) {
 			Data::real_tag_id.emplace_back(tid);
 #endif
 			Data::tag_name.emplace_back(move(tag_name));
-			fgets(buffer, 1024, fin);
 		}
 		Data::ntag = (int)Data::tag_name.size();
-		fclose(fin);
+		Data::rank_tag_name();
 	}
 	Data::person_in_tags.resize(Data::ntag);
 
@@ -443,95 +440,82 @@ void read_tags_forums_places(const string& dir) {
 	q4_tag_set = unordered_set<string, StringHashFunc>();
 
 	{		// read person->tags
-		safe_open(dir + "/person_hasInterest_tag.csv");
-		fgets(buffer, 1024, fin);
-		while (fscanf(fin, "%d|%d", &pid, &tid) == 2) {
-			int c_id = id_map[tid];
-			Data::tags[pid].insert(c_id);
-			Data::person_in_tags[c_id].emplace_back(pid);
+		MMapFile file(dir + "/person_hasInterest_tag.csv");
+		CSVTokenizer tk(file.begin(), file.end());
+		tk.skip_line();
+		int row[2];		// pid, tid
+		while (tk.next_row(row, 2)) {
+			int c_id = id_map[row[1]];
+			Data::tags[row[0]].insert(c_id);
+			Data::person_in_tags[c_id].emplace_back(row[0]);
 		}
-		fclose(fin);
 	}
+	snapshot_save_tags();
 
-	//read places, need tag data to sort
-	thread th(bind(read_places, dir));
-	th.detach();
-
-	print_debug("Read tag and places spent %lf secs\n", timer.get_time());
-	read_forum(dir, id_map, q4_tag_ids);
+	print_debug("Read tag spent %lf secs\n", timer.get_time());
 }
 
 void read_org_places(const string& fname, const vector<int>& org_places) {
-	char buffer[2048];
-	safe_open(fname);
-	fgets(buffer, 2048, fin);
-	int oid, pid;
-	while (fscanf(fin, "%d|%d", &pid, &oid) == 2) {
-		fgets(buffer, 2048, fin);
-		m_assert(oid % 10 == 0);
-
-		Data::places[org_places[oid / 10]].persons.emplace_back(pid);
+	MMapFile file(fname);
+	CSVTokenizer tk(file.begin(), file.end());
+	tk.skip_line();
+	int row[2];		// pid, oid
+	while (tk.next_row(row, 2)) {
+		m_assert(row[1] % 10 == 0);
+		Data::places[org_places[row[1] / 10]].persons.emplace_back(row[0]);
 	}
-	fclose(fin);
 }
 
 void build_places_tree(const string& dir) {
-	char buffer[2048];
-	int pid, max_pid = 0;
+	int max_pid = 0;
 	{
-		safe_open(dir + "/place.csv");
-		fgets(buffer, 2048, fin);
-		string place_name;
-		while (fscanf(fin, "%d|", &pid) == 1) {
-			place_name.clear();
-			char c;
-			while ((c = (char)fgetc(fin)) != '|')
-				place_name += c;
-			Data::placeid[place_name].emplace_back(pid);
+		MMapFile file(dir + "/place.csv");
+		CSVTokenizer tk(file.begin(), file.end());
+		tk.skip_line();
+		while (not tk.eof()) {
+			int pid = tk.next_int();
+			Data::placeid[tk.next_str()].emplace_back(pid);
+			tk.skip_line();
 			update_max(max_pid, pid);
-			fgets(buffer, 2048, fin);
 		}
 		Data::places.resize(max_pid + 1);
-		fclose(fin);
 	}
 
 	{
-		safe_open(dir + "/place_isPartOf_place.csv");
-		fgets(buffer, 2048, fin);
-		int p1, p2;
-		while (fscanf(fin, "%d|%d", &p1, &p2) == 2) {
-			Data::places[p2].sub_places.emplace_back(&Data::places[p1]);
-		}
-		fclose(fin);
+		MMapFile file(dir + "/place_isPartOf_place.csv");
+		CSVTokenizer tk(file.begin(), file.end());
+		tk.skip_line();
+		int row[2];
+		while (tk.next_row(row, 2))
+			Data::places[row[1]].sub_places.emplace_back(&Data::places[row[0]]);
 	}
 }
 
-void read_places(string dir) {
+// need tag data to sort
+void read_places(const string& dir) {
 	GuardedTimer tt("read places");
-	char buffer[1024];
 	build_places_tree(dir);
 
 	{
-		safe_open(dir + "/person_isLocatedIn_place.csv");
-		fgets(buffer, 1024, fin);
-		int person, place;
-		while (fscanf(fin, "%d|%d", &person, &place) == 2) {
-			Data::places[place].persons.emplace_back(person);
-		}
-		fclose(fin);
+		MMapFile file(dir + "/person_isLocatedIn_place.csv");
+		CSVTokenizer tk(file.begin(), file.end());
+		tk.skip_line();
+		int row[2];		// person, place
+		while (tk.next_row(row, 2))
+			Data::places[row[1]].persons.emplace_back(row[0]);
 	}
 
 	vector<int> org_places;
 	{
-		safe_open(dir + "/organisation_isLocatedIn_place.csv");
-		fgets(buffer, 1024, fin);
-		int pid, oid;
-		while (fscanf(fin, "%d|%d", &oid, &pid) == 2) {
-			m_assert(oid % 10 == 0);
-			m_assert(oid / 10 == (int)org_places.size());
-			org_places.emplace_back(pid);
+		MMapFile file(dir + "/organisation_isLocatedIn_place.csv");
+		CSVTokenizer tk(file.begin(), file.end());
+		tk.skip_line();
+		int row[2];		// oid, place
+		while (tk.next_row(row, 2)) {
+			m_assert(row[0] % 10 == 0);
+			m_assert(row[0] / 10 == (int)org_places.size());
+			org_places.emplace_back(row[1]);
 		}
-		fclose(fin);
 	}
 
 	read_org_places(dir + "/person_studyAt_organisation.csv", org_places);
@@ -543,16 +527,9 @@ void read_places(string dir) {
 		vector<PersonInPlace>::iterator last = unique(it->persons.begin(), it->persons.end());
 		it->persons.resize(distance(it->persons.begin(), last));
 	}
+	Data::place_index.build();
 
-	// q3 and q2 will start here
-	tag_read = true;
-	tag_read_cv.notify_all();
-}
-
-void read_data(const string& dir) {		// may need to be implemented synchronously
-	DEBUG_DECL(Timer, timer);
-	read_person_file(dir);
-	read_person_knows_person(dir);
+	snapshot_save_places();
 }
 
 /*		// cannot compile
@@ -607,95 +584,127 @@ int find_count(const std::vector<std::pair<std::pair<int, int>, int>> &count, co
 	return 0;
 }
 
-void read_comments_tim(const std::string &dir) {
-	char *ptr, *buf_end;
-
-	vector<int> owner;
-	Timer timer;
-	{
-		GuardedTimer guarded_timer("read comment_hasCreator_person.csv%d", 1);
-		int fd = open((dir + "/comment_hasCreator_person.csv").c_str(), O_RDONLY);
-		struct stat s; fstat(fd, &s);
-		size_t size = s.st_size;
-		void* mapped = mmap(0, size, PROT_READ, MAP_FILE|MAP_PRIVATE, fd, 0);
-//		madvise(mapped, size, MADV_WILLNEED);
+namespace {
+	// split [begin, end) into at most n pieces, each one starting at a line head
+	vector<char*> split_lines(char* begin, char* end, size_t n) {
+		vector<char*> bounds(1, begin);
+		size_t len = end - begin;
+		for (size_t i = 1; i < n; i ++) {
+			char* p = begin + len * i / n;
+			if (p <= bounds.back()) continue;
+			char* eol = (char*)memchr(p - 1, '\n', end - p + 1);
+			if (not eol) break;		// the last line has no '\n'
+			p = eol + 1;
+			if (p >= end) break;
+			if (p > bounds.back())
+				bounds.emplace_back(p);
+		}
+		bounds.emplace_back(end);
+		return bounds;
+	}
 
-//		ptr = (char*) mapped;
-//		buf_end = (char*) mapped + size;
+	// chunks of a file parsed by threadpool->parallel_for, a few per
+	// thread so that a slow chunk does not hold the others
+	size_t nr_reader_chunk()
+	{ return NUM_THREADS * 2; }
+
+	// parse comment_hasCreator_person lines of the i-th chunk into its owner slice
+	void parse_owner_chunk(const vector<char*>* bounds, vector<vector<int>>* slices, int i) {
+		CSVTokenizer tk((*bounds)[i], (*bounds)[i + 1]);
+		vector<int>& owner = (*slices)[i];
+		ULL row[2];		// cid, pid
+		while (tk.next_row(row, 2))
+			owner.emplace_back((int)row[1]);
+	}
 
-//		MMAP_READ_TILL_EOL();
-//		if (Data::nperson > 9000) owner.reserve(20100000);
+	void copy_owner_chunk(const vector<vector<int>>* slices, const vector<size_t>* start,
+			int* dst, int i) {
+		auto& src = (*slices)[i];
+		memcpy(dst + (*start)[i], src.data(), src.size() * sizeof(int));
+	}
 
+	// parse comment_replyOf_comment lines of the i-th chunk, keep pairs of friends
+	void parse_reply_chunk(const vector<char*>* bounds, const vector<int>* owner,
+			vector<vector<PII>>* pairs, int i) {
+		CSVTokenizer tk((*bounds)[i], (*bounds)[i + 1]);
+		vector<PII>* comments = &(*pairs)[i];
+		ULL cid[2];
+		while (tk.next_row(cid, 2)) {
+			int p1 = (*owner)[cid[0] / 10], p2 = (*owner)[cid[1] / 10];
+			if (p1 != p2) {
+				auto &h = Data::friends_hash[p1];
+				if (h.find(p2) != h.end())
+					comments->emplace_back(p1, p2);
+			}
+		}
+	}
+}
 
-		ptr = (char*) mapped;
-		buf_end = (char*) mapped + size;
+namespace {
+	// owner of every comment, from read_comment_owners to read_comment_replies
+	vector<int> comment_owner;
+}
 
-		char* seek = buf_end - 1024;
-		while (*seek++ != '\n');
-		ULL cid = 0;
-		while (*seek != '|') cid = cid * 10 + (*(seek++) - '0');
+void read_comment_owners(const std::string &dir) {
+	vector<int>& owner = comment_owner;
+	{
+		GuardedTimer guarded_timer("read comment_hasCreator_person.csv%d", 1);
+		MMapFile file(dir + "/comment_hasCreator_person.csv", MADV_WILLNEED);
+		char *ptr = file.begin(), *buf_end = file.end();
+
+		ULL cid;
+		{		// cid of one of the last lines
+			CSVTokenizer tk(max(buf_end - 1024, ptr), buf_end);
+			tk.skip_line();
+			cid = tk.next_ull();
+		}
 		fprintf(stderr, "ncmt<%llu\n", cid); fflush(stderr);
-		madvise(mapped, size, MADV_SEQUENTIAL);
-		MMAP_READ_TILL_EOL();
-		owner.reserve(cid / 10 + 1000);
-
-		do {
-			do { ptr ++; } while (*ptr != '|');
-			ptr ++;
-			int pid = 0;
-			do {
-				pid = pid * 10 + *ptr - '0';
-				ptr ++;
-			} while (*ptr != '\n');
-			owner.emplace_back(pid);
-			ptr ++;
-		} while (ptr != buf_end);
-		munmap(mapped, size);
-		close(fd);
+		ptr = (char*)memchr(ptr, '\n', buf_end - ptr) + 1;
+
+		// each chunk fills its own slice of owner, which are then stitched in order
+		vector<char*> bounds = split_lines(ptr, buf_end, nr_reader_chunk());
+		size_t nr_chunk = bounds.size() - 1;
+		vector<vector<int>> slices(nr_chunk);
+		REP(i, nr_chunk)
+			slices[i].reserve((size_t)((double)(cid / 10 + 1) *
+						(double)(bounds[i + 1] - bounds[i]) / (double)(buf_end - ptr)) + 1000);
+		threadpool->parallel_for(0, (int)nr_chunk,
+				bind(parse_owner_chunk, &bounds, &slices, placeholders::_1), 1);
+
+		vector<size_t> start(nr_chunk + 1, 0);
+		REP(i, nr_chunk) start[i + 1] = start[i] + slices[i].size();
+		owner.resize(start[nr_chunk]);
+		threadpool->parallel_for(0, (int)nr_chunk,
+				bind(copy_owner_chunk, &slices, &start, owner.data(), placeholders::_1), 1);
 	}
+}
 
-	WAIT_FOR(friends_hash_built);
+// needs the owners and friends_hash
+void read_comment_replies(const std::string &dir) {
+	vector<int> owner;
+	owner.swap(comment_owner);
+	Timer timer;
 
 	vector<PII> comments;
 	{
 		GuardedTimer guarded_timer("read comment_replyOf_comment.csv");
 
-		// using mmap
-		int fd = open((dir + "/comment_replyOf_comment.csv").c_str(), O_RDONLY);
-		struct stat s; fstat(fd, &s);
-		size_t size = s.st_size;
-		void* mapped = mmap(0, size, PROT_READ, MAP_FILE|MAP_PRIVATE, fd, 0);
-//		madvise(mapped, size, MADV_WILLNEED);
-		madvise(mapped, size, MADV_SEQUENTIAL);
-
-		ptr = (char*)mapped;
-		buf_end = (char*)mapped + size;
-
-		MMAP_READ_TILL_EOL();
-		do {
-			unsigned long long cid1 = 0;
-			do {
-				cid1 = cid1 * 10 + *ptr - '0';
-				ptr ++;
-			} while (*ptr != '|');
-			ptr ++;
-			unsigned long long cid2 = 0;
-			do {
-				cid2 = cid2 * 10 + *ptr - '0';
-				ptr ++;
-			} while (*ptr != '\n');
-
-			int p1 = owner[cid1 / 10], p2 = owner[cid2 / 10];
-			if (p1 != p2) {
-				auto &h = Data::friends_hash[p1];
-				if (h.find(p2) != h.end())
-					comments.emplace_back(p1, p2);
-			}
-
-			ptr ++;
-		} while (ptr != buf_end);
-		munmap(mapped, size);
-		close(fd);
+		MMapFile file(dir + "/comment_replyOf_comment.csv", MADV_WILLNEED);
+		char *ptr = file.begin(), *buf_end = file.end();
+		ptr = (char*)memchr(ptr, '\n', buf_end - ptr) + 1;
+		vector<char*> bounds = split_lines(ptr, buf_end, nr_reader_chunk());
+		size_t nr_chunk = bounds.size() - 1;
+		vector<vector<PII>> pairs(nr_chunk);
+		threadpool->parallel_for(0, (int)nr_chunk,
+				bind(parse_reply_chunk, &bounds, &owner, &pairs, placeholders::_1), 1);
+
+		size_t nr_pair = 0;
+		FOR_ITR(p, pairs) nr_pair += p->size();
+		comments.reserve(nr_pair);
+		FOR_ITR(p, pairs) {
+			comments.insert(comments.end(), p->begin(), p->end());
+			FreeAll(*p);
+		}
 	}
 	Data::friends_hash = vector<unordered_set<int>>();
 
@@ -722,7 +731,7 @@ void read_comments_tim(const std::string &dir) {
 		GuardedTimer timer("build graph");		// very fast (0.05s/300k)
 		int index = 0;
 		REP(i, Data::nperson) {
-			auto& fs = Data::friends[i];
+			auto fs = Data::friends[i];
 			FOR_ITR(itr, fs) {
 				int j = itr->pid;
 				PII now_pair = make_pair(i, j);
@@ -740,6 +749,8 @@ void read_comments_tim(const std::string &dir) {
 			if (index == (int)count.size()) break;
 		}
 	}
+	snapshot_save_friends();
+	Data::friends.sort_by_cmts();
 	print_debug("Read comment spent %lf secs\n", timer.get_time());
 }
 
@@ -5,15 +5,15 @@
 #pragma once
 #include <string>
 
-void read_data(const std::string&);
+// loading stages, each after the ones it reads from
+void read_person_file(const std::string&);
+void read_comment_owners(const std::string &dir);
+void read_person_knows_person(const std::string&);		// persons
+void build_friends_hash();		// knows
+void read_tags(const std::string&);			// persons
+void read_places(const std::string&);		// tags
+void read_forums(const std::string&);		// tags
+void read_comment_replies(const std::string &dir);		// owners, friends hash
+
 void read_comments(const std::string&);
 void read_comments_2file(const std::string&);
-void read_comments_tim(const std::string &dir);
-void read_tags_forums_places(const std::string&);
-
-
-
-
-void read_places(std::string);
-void read_person_file(const std::string&);
-void read_person_knows_person(const std::string&);
@@ -0,0 +1,224 @@
+//File: server.cpp
+//Date: Sat Oct 17 20:05:37 2026 +0000
+
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "data.h"
+#include "globals.h"
+#include "lib/common.h"
+#include "lib/debugutils.h"
+#include "lib/utils.h"
+#include "query1.h"
+#include "query2.h"
+#include "query3.h"
+#include "query4.h"
+using namespace std;
+
+extern Query1Handler q1;
+extern Query2Handler q2;
+extern Query3Handler q3;
+extern Query4Handler q4;
+
+namespace {
+	const char* INVALID_QUERY = "invalid query";
+
+	// answers of one stream, written in the order of the queries
+	struct Stream {
+		FILE* out;
+		mutex mt;
+		condition_variable idle;
+		// (done, answer) of the queries not written yet, the first is query first_id
+		deque<pair<bool, string>> pending;
+		long long first_id;
+		int nr_running;
+
+		Stream(FILE* _out): out(_out), first_id(0), nr_running(0) {}
+	};
+
+	void finish(Stream* st, long long id, string answer) {
+		lock_guard<mutex> lg(st->mt);
+		auto& slot = st->pending[id - st->first_id];
+		slot.first = true;
+		slot.second.swap(answer);
+		bool written = false;
+		while (not st->pending.empty() and st->pending.front().first) {
+			fprintf(st->out, "%s\n", st->pending.front().second.c_str());
+			st->pending.pop_front();
+			st->first_id ++;
+			written = true;
+		}
+		if (written)
+			fflush(st->out);
+		if (-- st->nr_running == 0)
+			st->idle.notify_all();
+	}
+
+	void run_query(Stream* st, long long id, function<string()> f) {
+		finish(st, id, f());
+	}
+
+	string answer_1(int p1, int p2, int x) {
+		return string_format("%d", q1.answer(Query1(p1, p2, x)));
+	}
+
+	string answer_2(int k, int d) {
+		string ret;
+		auto tags = q2.answer(k, d);
+		FOR_ITR(itr, tags) {
+			if (itr != tags.begin()) ret += ' ';
+			ret += *itr;
+		}
+		return ret;
+	}
+
+	string answer_3(int k, int h, const string& place) {
+		string ret;
+		// no more answers than pairs in the place
+		long long np = (long long)Data::place_index.persons_of(place)->size();
+		k = (int)min((long long)k, np * np);
+		auto ans = q3.answer(k, h, place);
+		FOR_ITR(itr, ans) {
+			if (itr != ans.begin()) ret += ' ';
+			ret += string_format("%d|%d", itr->p1, itr->p2);
+		}
+		return ret;
+	}
+
+	string answer_4(int k, const string& tag) {
+		string ret;
+		k = min(k, Data::nperson);		// no more answers than persons
+		auto ans = q4.answer(k, tag);
+		FOR_ITR(itr, ans) {
+			if (itr != ans.begin()) ret += ' ';
+			ret += string_format("%d", *itr);
+		}
+		return ret;
+	}
+
+	bool valid_person(int p)
+	{ return p >= 0 && p < Data::nperson; }
+
+	// the answering function of a query line and its priority,
+	// an empty function if the line is invalid
+	function<string()> parse_query(const char* line, int& priority) {
+		int type, k, n;
+		vector<char> name(strlen(line) + 1);		// place or tag, fits any line
+		char* buf = name.data();
+		if (sscanf(line, " query%d(%n", &type, &n) != 1)
+			return nullptr;
+		line += n;
+		switch (type) {
+			case 1:
+				{
+					int p1, p2, x;
+					if (sscanf(line, "%d, %d, %d)", &p1, &p2, &x) != 3 ||
+							not valid_person(p1) || not valid_person(p2))
+						return nullptr;
+					priority = 20;
+					return bind(answer_1, p1, p2, x);
+				}
+			case 2:
+				{
+					int y, m, d;
+					if (sscanf(line, "%d, %d-%d-%d)", &k, &y, &m, &d) != 4 || k <= 0)
+						return nullptr;
+					priority = 20;
+					return bind(answer_2, k, 10000 * y + 100 * m + d);
+				}
+			case 3:
+				{
+					int h;
+					if (sscanf(line, "%d, %d, %[^)])", &k, &h, buf) != 3 || k <= 0)
+						return nullptr;
+					priority = 5;
+					return bind(answer_3, k, h, string(buf));
+				}
+			case 4:
+				{
+					if (sscanf(line, "%d, %[^)])", &k, buf) != 2 || k <= 0)
+						return nullptr;
+					priority = 10;
+					return bind(answer_4, k, string(buf));
+				}
+		}
+		return nullptr;
+	}
+
+	string invalid_query() { return INVALID_QUERY; }
+}
+
+void serve_stream(FILE* in, FILE* out) {
+	Stream st(out);
+	char* line = NULL;		// grown by getline to the longest line
+	size_t cap = 0;
+	long long id = 0;
+	while (getline(&line, &cap, in) != -1) {
+		if (strspn(line, " \t\r\n") == strlen(line))		// blank
+			continue;
+		int priority = 5;
+		auto f = parse_query(line, priority);
+		if (not f)
+			f = invalid_query;
+		{
+			lock_guard<mutex> lg(st.mt);
+			st.pending.emplace_back(false, string());
+			st.nr_running ++;
+		}
+		threadpool->enqueue(bind(run_query, &st, id ++, f), priority);
+	}
+	free(line);
+
+	unique_lock<mutex> lock(st.mt);
+	while (st.nr_running > 0)
+		st.idle.wait(lock);
+}
+
+void serve_socket(const string& path) {
+	signal(SIGPIPE, SIG_IGN);		// a client may leave before its answers
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "socket path too long: %s\n", path.c_str());
+		exit(1);
+	}
+	strcpy(addr.sun_path, path.c_str());
+	unlink(path.c_str());
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || ::bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+		perror(path.c_str());
+		exit(1);
+	}
+	fprintf(stderr, "serving on %s\n", path.c_str());
+
+	// one connection at a time, its queries still run in parallel
+	for (; ;) {
+		int conn = accept(fd, NULL, NULL);
+		if (conn < 0)
+			continue;
+		FILE* in = fdopen(conn, "r");
+		FILE* out = fdopen(dup(conn), "w");
+		if (in == NULL || out == NULL) {
+			perror("fdopen");
+			exit(1);
+		}
+		serve_stream(in, out);
+		fclose(out);
+		fclose(in);
+	}
+}
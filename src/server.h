@@ -0,0 +1,24 @@
+//File: server.h
+//Date: Sat Oct 17 20:05:37 2026 +0000
+
+
+#pragma once
+#include <cstdio>
+#include <string>
+
+// Server mode: the dataset is loaded once, then queries are read one per
+// line, in the format of the query file, and answered on the threadpool.
+// Answers are written one per line, in the format of the batch output and
+// in the order the queries arrived; an invalid line is answered with
+// "invalid query".
+//
+// Data and the indexes derived from it are kept between queries:
+// server_mode must be set before loading, and q2.online and q4 tag states
+// are used instead of the batch handlers.
+
+// serve the queries of in until its end, and return once all are answered
+void serve_stream(FILE* in, FILE* out);
+
+// accept connections on a unix domain socket at path, and serve each of
+// them as a stream. never returns
+void serve_socket(const std::string& path);
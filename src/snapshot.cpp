@@ -0,0 +1,556 @@
+//File: snapshot.cpp
+//Date: Sat Oct 17 17:36:40 2026 +0000
+
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "snapshot.h"
+#include "data.h"
+#include "globals.h"
+#include "lib/common.h"
+#include "lib/debugutils.h"
+#include "lib/hash_lib.h"
+#include "lib/Timer.h"
+#include "lib/utils.h"
+using namespace std;
+
+
+namespace {
+	const char SNAPSHOT_MAGIC[8] = {'S', 'G', 'M', 'D', 'S', 'N', 'A', 'P'};
+
+	const char* SOURCE_FILES[] = {
+		"person.csv", "person_knows_person.csv",
+		"comment_hasCreator_person.csv", "comment_replyOf_comment.csv",
+		"tag.csv", "person_hasInterest_tag.csv",
+		"forum_hasTag_tag.csv", "forum_hasMember_person.csv",
+		"place.csv", "place_isPartOf_place.csv", "person_isLocatedIn_place.csv",
+		"organisation_isLocatedIn_place.csv",
+		"person_studyAt_organisation.csv", "person_workAt_organisation.csv"
+	};
+
+	enum Section {
+		SEC_PERSONS, SEC_FRIENDS, SEC_TAGS, SEC_PLACES, SEC_FORUMS,
+		NR_SECTION
+	};
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t nr_section;
+		uint64_t fingerprint;
+		uint64_t checksum;
+		uint64_t payload_size;
+	};
+
+	class BinaryWriter {
+		public:
+			std::string buf;
+
+			template <typename T>
+			void put(const T& v)
+			{ buf.append((const char*)&v, sizeof(T)); }
+
+			template <typename T>
+			void put_arr(const T* p, size_t n) {
+				put((uint64_t)n);
+				buf.append((const char*)p, n * sizeof(T));
+			}
+
+			template <typename T>
+			void put_vec(const std::vector<T>& v)
+			{ put_arr(v.data(), v.size()); }
+
+			void put_str(const std::string& s)
+			{ put_arr(s.data(), s.size()); }
+
+			// a vector of vectors, as (offsets, values)
+			template <typename T>
+			void put_csr(const std::vector<int>& offset, const std::vector<T>& values) {
+				put_vec(offset);
+				put_vec(values);
+			}
+
+			template <typename T>
+			void put_csr(const std::vector<std::vector<T>>& v) {
+				std::vector<int> offset(1, 0);
+				offset.reserve(v.size() + 1);
+				size_t n = 0;
+				FOR_ITR(itr, v) {
+					n += itr->size();
+					offset.emplace_back((int)n);
+				}
+				put_vec(offset);
+				put((uint64_t)n);
+				FOR_ITR(itr, v)
+					buf.append((const char*)itr->data(), itr->size() * sizeof(T));
+			}
+	};
+
+	class BinaryReader {
+		public:
+			const char *ptr, *end;
+			bool ok;
+
+			BinaryReader(const char* _ptr, const char* _end):
+				ptr(_ptr), end(_end), ok(true) {}
+
+			bool has(size_t len) {
+				if (not ok or (size_t)(end - ptr) < len)
+					ok = false;
+				return ok;
+			}
+
+			template <typename T>
+			T get() {
+				T ret = T();
+				if (has(sizeof(T))) {
+					memcpy(&ret, ptr, sizeof(T));
+					ptr += sizeof(T);
+				}
+				return ret;
+			}
+
+			// return pointer to n elements of T inside the mapped file
+			template <typename T>
+			const T* get_arr(size_t& n) {
+				n = (size_t)get<uint64_t>();
+				if (not has(n * sizeof(T))) {
+					n = 0;
+					return NULL;
+				}
+				const T* ret = (const T*)ptr;
+				ptr += n * sizeof(T);
+				return ret;
+			}
+
+			template <typename T>
+			void get_vec(std::vector<T>& v) {
+				size_t n;
+				const T* p = get_arr<T>(n);
+				v.resize(n);
+				if (n) memcpy(v.data(), p, n * sizeof(T));
+			}
+
+			std::string get_str() {
+				size_t n;
+				const char* p = get_arr<char>(n);
+				return std::string(p ? p : "", n);
+			}
+
+			// offsets and values written by BinaryWriter::put_csr
+			template <typename T>
+			bool get_csr(std::vector<int>& offset, const T*& values) {
+				get_vec(offset);
+				size_t n;
+				values = get_arr<T>(n);
+				if (offset.empty() or offset.back() != (int)n or offset.front() != 0)
+					return ok = false;
+				REP(i, offset.size() - 1)
+					if (offset[i] > offset[i + 1])
+						ok = false;
+				return ok;
+			}
+	};
+
+	std::mutex writer_mt;
+	bool collecting = false;
+	std::string snapshot_dir, snapshot_path;
+	std::vector<std::string> sections(NR_SECTION);
+	std::vector<bool> section_done(NR_SECTION, false);
+
+	uint64_t checksum(const char* data, size_t len) {
+		const size_t BLOCK = 1 << 20;
+		uint64_t h = 0;
+		for (size_t i = 0; i < len; i += BLOCK) {
+			size_t l = min(BLOCK, len - i);
+			h = MurmurHash64A(data + i, (int)l, (unsigned)(h ^ (h >> 32)));
+		}
+		return h;
+	}
+
+	// hash of (name, size, mtime) of every source file. 0 if one is missing
+	uint64_t fingerprint(const std::string& dir) {
+		BinaryWriter w;
+		for (size_t i = 0; i < sizeof(SOURCE_FILES) / sizeof(SOURCE_FILES[0]); i ++) {
+			struct stat s;
+			if (stat((dir + "/" + SOURCE_FILES[i]).c_str(), &s) != 0)
+				return 0;
+			w.put_str(SOURCE_FILES[i]);
+			w.put((uint64_t)s.st_size);
+			w.put((uint64_t)s.st_mtim.tv_sec);
+			w.put((uint64_t)s.st_mtim.tv_nsec);
+		}
+		uint64_t ret = checksum(w.buf.data(), w.buf.size());
+		return ret ? ret : 1;
+	}
+
+	void write_snapshot(std::vector<std::string>& secs) {
+		Timer timer;
+		uint64_t fp = fingerprint(snapshot_dir);
+		if (fp == 0) return;
+
+		Header header;
+		memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+		header.version = SNAPSHOT_VERSION;
+		header.nr_section = NR_SECTION;
+		header.fingerprint = fp;
+
+		BinaryWriter payload;
+		FOR_ITR(itr, secs)
+			payload.put_str(*itr);
+		FreeAll(secs);
+		header.payload_size = payload.buf.size();
+		header.checksum = checksum(payload.buf.data(), payload.buf.size());
+
+		// write to a temporary file first, so a crash never leaves a broken snapshot
+		std::string fname = snapshot_path,
+			tmp_fname = fname + ".tmp";
+		FILE* fout = fopen(tmp_fname.c_str(), "wb");
+		if (fout == NULL) {
+			print_debug("Cannot write snapshot to %s\n", tmp_fname.c_str());
+			return;
+		}
+		bool ok = fwrite(&header, sizeof(header), 1, fout) == 1 and
+			fwrite(payload.buf.data(), 1, payload.buf.size(), fout) == payload.buf.size();
+		ok = (fclose(fout) == 0) and ok;
+		if (not ok or rename(tmp_fname.c_str(), fname.c_str()) != 0) {
+			unlink(tmp_fname.c_str());
+			return;
+		}
+		print_debug("Write snapshot of %lu bytes spent %lf secs\n",
+				(size_t)header.payload_size, timer.get_time());
+	}
+
+	void add_section(Section id, BinaryWriter& w) {
+		std::lock_guard<std::mutex> lg(writer_mt);
+		if (not collecting) return;
+		sections[id].swap(w.buf);
+		section_done[id] = true;
+	}
+
+	void clear_data() {
+		Data::nperson = 0;
+		Data::ntag = 0;
+		delete[] Data::birthday;
+		Data::birthday = NULL;
+		Data::friends.clear();
+		FreeAll(Data::tags);
+		FreeAll(Data::person_in_tags);
+		FreeAll(Data::tag_name);
+		FreeAll(Data::tag_rank);
+		FreeAll(Data::places);
+		Data::place_index.free();
+		Data::placeid.clear();
+		FreeAll(Data::tag_forums);
+		FreeAll(Data::forum_members);
+		Data::tagid.clear();
+		q4_persons.clear();
+	}
+
+	bool load_persons(BinaryReader& r) {
+		Data::nperson = r.get<int>();
+		size_t n;
+		const int* birthday = r.get_arr<int>(n);
+		if (not r.ok or Data::nperson <= 0 or n != (size_t)Data::nperson)
+			return false;
+		Data::birthday = new int[n];
+		memcpy(Data::birthday, birthday, n * sizeof(int));
+		return true;
+	}
+
+	bool load_friends(BinaryReader& r) {
+		vector<int> offset, offset_cmts;
+		const int *pid, *ncmts;
+		if (not r.get_csr(offset, pid) or not r.get_csr(offset_cmts, ncmts))
+			return false;
+		if (offset.size() != (size_t)Data::nperson + 1 or offset != offset_cmts)
+			return false;
+		size_t n = offset.back();
+		REP(j, n)
+			if (pid[j] < 0 or pid[j] >= Data::nperson)
+				return false;
+		auto& g = Data::friends;
+		g.offset.swap(offset);
+		g.pid.assign(pid, pid + n);
+		g.ncmts.assign(ncmts, ncmts + n);
+		g.sort_by_cmts();
+		return true;
+	}
+
+	bool load_tags(BinaryReader& r) {
+		Data::ntag = r.get<int>();
+		if (not r.ok or Data::ntag < 0) return false;
+		Data::tag_name.reserve(Data::ntag);
+		REP(i, Data::ntag)
+			Data::tag_name.emplace_back(r.get_str());
+		Data::rank_tag_name();
+
+		vector<int> offset;
+		const int* tid;
+		if (not r.get_csr(offset, tid) or offset.size() != (size_t)Data::nperson + 1)
+			return false;
+		Data::tags.resize(Data::nperson);
+		Data::person_in_tags.resize(Data::ntag);
+		REP(i, Data::nperson) {
+			for (int j = offset[i]; j < offset[i + 1]; j ++) {
+				if (tid[j] < 0 or tid[j] >= Data::ntag)
+					return false;
+				Data::tags[i].insert(Data::tags[i].end(), tid[j]);
+				Data::person_in_tags[tid[j]].emplace_back(i);
+			}
+		}
+		return true;
+	}
+
+	bool load_places(BinaryReader& r) {
+		int nplace = r.get<int>();
+		if (not r.ok or nplace < 0) return false;
+		Data::places.resize(nplace);
+		vector<int> offset;
+		const int* sub;
+		if (not r.get_csr(offset, sub) or offset.size() != (size_t)nplace + 1)
+			return false;
+		REP(i, nplace) for (int j = offset[i]; j < offset[i + 1]; j ++) {
+			if (sub[j] < 0 or sub[j] >= nplace)
+				return false;
+			Data::places[i].sub_places.emplace_back(&Data::places[sub[j]]);
+		}
+
+		const int* persons;
+		if (not r.get_csr(offset, persons) or offset.size() != (size_t)nplace + 1)
+			return false;
+		REP(i, nplace) {
+			auto& ps = Data::places[i].persons;
+			ps.reserve(offset[i + 1] - offset[i]);
+			for (int j = offset[i]; j < offset[i + 1]; j ++) {
+				if (persons[j] < 0 or persons[j] >= Data::nperson)
+					return false;
+				ps.emplace_back(persons[j]);
+			}
+		}
+
+		int nname = r.get<int>();
+		REP(i, nname) {
+			string name = r.get_str();
+			r.get_vec(Data::placeid[name]);
+		}
+		if (r.ok)
+			Data::place_index.build();
+		return r.ok;
+	}
+
+	// fill q4_persons of the current q4 tags, the same as read_forum,
+	// and keep all forums in server mode
+	bool load_forums(BinaryReader& r) {
+		vector<int> tag_offset, member_offset;
+		const int *tags, *members;
+		if (not r.get_csr(tag_offset, tags) or not r.get_csr(member_offset, members))
+			return false;
+		if (tag_offset.size() != member_offset.size())
+			return false;
+		// every id is checked before the q4 globals are touched, so a
+		// rejected snapshot leaves them as read_forum expects them
+		for (int j = 0; j < tag_offset.back(); j ++)
+			if (tags[j] < 0 or tags[j] >= Data::ntag)
+				return false;
+		for (int j = 0; j < member_offset.back(); j ++)
+			if (members[j] < 0 or members[j] >= Data::nperson)
+				return false;
+
+		FOR_ITR(nameitr, q4_tag_set)
+			q4_persons[*nameitr].resize(Data::nperson, false);
+		vector<vector<bool>*> q4_hash(Data::ntag, NULL);
+		REP(i, Data::ntag)
+			if (q4_tag_set.count(Data::tag_name[i]))
+				q4_hash[i] = &q4_persons[Data::tag_name[i]];
+		q4_tag_set = unordered_set<string, StringHashFunc>();
+
+		vector<vector<bool>*> hashes;
+		REP(i, tag_offset.size() - 1) {
+			hashes.clear();
+			for (int j = tag_offset[i]; j < tag_offset[i + 1]; j ++)
+				if (q4_hash[tags[j]])
+					hashes.emplace_back(q4_hash[tags[j]]);
+			if (hashes.empty()) continue;
+			for (int j = member_offset[i]; j < member_offset[i + 1]; j ++)
+				FOR_ITR(hs, hashes)
+					(*(*hs))[members[j]] = true;
+		}
+
+		if (server_mode) {
+			size_t nforum = tag_offset.size() - 1;
+			vector<vector<int>> forum_tags(nforum), forum_members(nforum);
+			REP(i, nforum) {
+				forum_tags[i].assign(tags + tag_offset[i], tags + tag_offset[i + 1]);
+				forum_members[i].assign(members + member_offset[i],
+						members + member_offset[i + 1]);
+			}
+			Data::set_forums(forum_tags, forum_members);
+		}
+		return true;
+	}
+}
+
+bool snapshot_load(const string& dir, const char* path) {
+#ifndef USE_SNAPSHOT
+	(void)dir; (void)path;
+	return false;
+#else
+	if (path == NULL) return false;
+	Timer timer;
+	uint64_t fp = fingerprint(dir);
+	if (fp == 0) return false;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat s; fstat(fd, &s);
+	size_t size = s.st_size;
+	if (size < sizeof(Header)) {
+		close(fd);
+		return false;
+	}
+	void* mapped = mmap(0, size, PROT_READ, MAP_FILE|MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) return false;
+	madvise(mapped, size, MADV_SEQUENTIAL);
+
+	const char* base = (const char*)mapped;
+	Header header;
+	memcpy(&header, base, sizeof(header));
+	const char* payload = base + sizeof(header);
+	bool ok = memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0 and
+		header.version == SNAPSHOT_VERSION and
+		header.nr_section == NR_SECTION and
+		header.fingerprint == fp and
+		header.payload_size == size - sizeof(header) and
+		header.checksum == checksum(payload, header.payload_size);
+	if (not ok) {
+		print_debug("Reject stale snapshot %s\n", path);
+		munmap(mapped, size);
+		return false;
+	}
+
+	BinaryReader r(payload, base + size);
+	vector<BinaryReader> sec;
+	REP(i, (int)NR_SECTION) {
+		size_t len;
+		const char* p = r.get_arr<char>(len);
+		sec.emplace_back(p, p + len);
+	}
+	ok = r.ok and
+		load_persons(sec[SEC_PERSONS]) and
+		load_friends(sec[SEC_FRIENDS]) and
+		load_tags(sec[SEC_TAGS]) and
+		load_places(sec[SEC_PLACES]) and
+		load_forums(sec[SEC_FORUMS]);
+	munmap(mapped, size);
+	if (not ok) {
+		print_debug("Broken snapshot %s\n", path);
+		clear_data();
+		return false;
+	}
+
+	print_debug("Load snapshot spent %lf secs\n", timer.get_time());
+	return true;
+#endif
+}
+
+void snapshot_begin(const string& dir, const char* path) {
+#ifdef USE_SNAPSHOT
+	if (path == NULL) return;
+	std::lock_guard<std::mutex> lg(writer_mt);
+	snapshot_dir = dir;
+	snapshot_path = path;
+	collecting = true;
+#else
+	(void)dir; (void)path;
+#endif
+}
+
+void snapshot_write() {
+	vector<string> payload;
+	{
+		std::lock_guard<std::mutex> lg(writer_mt);
+		if (not collecting) return;
+		collecting = false;
+		REP(i, (int)NR_SECTION)
+			if (not section_done[i])		// a loader did not finish
+				return;
+		payload.swap(sections);
+	}
+	write_snapshot(payload);
+}
+
+bool snapshot_collecting() {
+	std::lock_guard<std::mutex> lg(writer_mt);
+	return collecting;
+}
+
+void snapshot_save_persons() {
+	if (not snapshot_collecting()) return;
+	BinaryWriter w;
+	w.put(Data::nperson);
+	w.put_arr(Data::birthday, Data::nperson);
+	add_section(SEC_PERSONS, w);
+}
+
+void snapshot_save_friends() {
+	if (not snapshot_collecting()) return;
+	const auto& g = Data::friends;
+	BinaryWriter w;
+	w.put_csr(g.offset, g.pid);
+	w.put_csr(g.offset, g.ncmts);
+	add_section(SEC_FRIENDS, w);
+}
+
+void snapshot_save_tags() {
+	if (not snapshot_collecting()) return;
+	BinaryWriter w;
+	w.put(Data::ntag);
+	REP(i, Data::ntag)
+		w.put_str(Data::tag_name[i]);
+	vector<vector<int>> tags(Data::nperson);
+	REP(i, Data::nperson)
+		tags[i].assign(Data::tags[i].begin(), Data::tags[i].end());
+	w.put_csr(tags);
+	add_section(SEC_TAGS, w);
+}
+
+void snapshot_save_places() {
+	if (not snapshot_collecting()) return;
+	int nplace = (int)Data::places.size();
+	vector<vector<int>> sub(nplace), persons(nplace);
+	REP(i, nplace) {
+		FOR_ITR(itr, Data::places[i].sub_places)
+			sub[i].emplace_back((int)(*itr - Data::places.data()));
+		FOR_ITR(itr, Data::places[i].persons)
+			persons[i].emplace_back(itr->pid);
+	}
+	BinaryWriter w;
+	w.put(nplace);
+	w.put_csr(sub);
+	w.put_csr(persons);
+	w.put((int)Data::placeid.size());
+	FOR_ITR(itr, Data::placeid) {
+		w.put_str(itr->first);
+		w.put_vec(itr->second);
+	}
+	add_section(SEC_PLACES, w);
+}
+
+void snapshot_save_forums(const vector<vector<int>>& forum_tags,
+		const vector<vector<int>>& forum_members) {
+	if (not snapshot_collecting()) return;
+	BinaryWriter w;
+	w.put_csr(forum_tags);
+	w.put_csr(forum_members);
+	add_section(SEC_FORUMS, w);
+}
@@ -0,0 +1,45 @@
+//File: snapshot.h
+//Date: Sat Oct 17 17:36:40 2026 +0000
+
+
+#pragma once
+#include <string>
+#include <vector>
+
+// Binary snapshot of the derived graph state, so a restart on an unchanged
+// dataset can skip all csv parsing.
+//
+// It is only used when a path is given (GRAPH_SNAPSHOT=<file> for main), and
+// never written into the data dir. It is tagged with a format version, a
+// fingerprint of (name, size, mtime) of every source csv of the data dir and
+// a checksum of the payload; any mismatch makes snapshot_load() reject it.
+//
+// Cold path: snapshot_begin() is called when loading failed, and every loader
+// hands over its section as soon as its part of Data is final.
+// snapshot_write() writes the file once all loaders are done, from a
+// background stage so it stays off the loading critical path.
+
+const unsigned SNAPSHOT_VERSION = 1;
+
+// try to fill Data from a valid snapshot.
+// on success all loaders are done, except q4_persons
+// which is built for the current q4_tag_set as read_forum does.
+// path may be NULL, for no snapshot.
+bool snapshot_load(const std::string& dir, const char* path);
+
+// start collecting sections for a snapshot of dir, to be written to path.
+// nothing is collected if path is NULL
+void snapshot_begin(const std::string& dir, const char* path);
+bool snapshot_collecting();
+
+// write the collected sections, if all of them are there
+void snapshot_write();
+
+void snapshot_save_persons();		// nperson, birthday
+void snapshot_save_friends();		// friends with ncmts
+void snapshot_save_tags();			// tag names, per-person tags
+void snapshot_save_places();		// place tree, place names and persons
+// forum_tags[i]: continuous tag ids of the i-th forum,
+// forum_members[i]: persons of the i-th forum
+void snapshot_save_forums(const std::vector<std::vector<int>>& forum_tags,
+		const std::vector<std::vector<int>>& forum_members);
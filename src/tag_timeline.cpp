@@ -0,0 +1,92 @@
+//File: tag_timeline.cpp
+//Date: Sat Oct 17 21:32:40 2026 +0000
+
+
+#include <algorithm>
+#include <queue>
+
+#include "tag_timeline.h"
+#include "data.h"
+#include "lib/common.h"
+#include "lib/utils.h"
+using namespace std;
+
+namespace {
+	struct FinalSizeCmp {
+		const vector<int>* last;
+		FinalSizeCmp(const vector<int>* _last): last(_last) {}
+		bool operator () (int a, int b) const
+		{ return (*last)[a] > (*last)[b]; }
+	};
+
+	// (size, rank), whether a ranks before b.
+	// the top of priority_queue is then the worst kept tag
+	struct Better {
+		bool operator () (const pair<int, int>& a, const pair<int, int>& b) const
+		{ return a.first > b.first || (a.first == b.first && a.second < b.second); }
+	};
+}
+
+void TagTimeline::build(vector<vector<pair<int, int>>>& events,
+		const vector<string>& names) {
+	int ntag = (int)events.size();
+	offset.assign(1, 0);
+	offset.reserve(ntag + 1);
+	vector<int> last(ntag, 0);
+	REP(t, ntag) {
+		FOR_ITR(e, events[t]) {
+			date.emplace_back(e->first);
+			size.emplace_back(e->second);
+		}
+		if (not events[t].empty())
+			last[t] = events[t].back().second;
+		offset.emplace_back((int)date.size());
+		FreeAll(events[t]);
+	}
+
+	order.resize(ntag);
+	REP(t, ntag) order[t] = (int)t;
+	stable_sort(order.begin(), order.end(), FinalSizeCmp(&last));
+
+	rank = Data::tag_rank;
+	by_rank.resize(ntag);
+	REP(t, ntag) by_rank[rank[t]] = (int)t;
+	tag_name = names;
+}
+
+int TagTimeline::size_at(int tag, int d) const {
+	// date is non-increasing in each tag: find the last change point >= d
+	auto b = date.begin() + offset[tag], e = date.begin() + offset[tag + 1];
+	auto p = upper_bound(b, e, d, greater<int>());
+	if (p == b) return 0;
+	return size[p - date.begin() - 1];
+}
+
+vector<int> TagTimeline::top_k(int k, int d) const {
+	k = min(k, (int)order.size());
+	if (k <= 0)
+		return vector<int>();
+	priority_queue<pair<int, int>, vector<pair<int, int>>, Better> kept;
+	FOR_ITR(itr, order) {
+		int t = *itr;
+		if ((int)kept.size() == k) {
+			// no later tag can grow beyond its final size
+			int final_size = offset[t] == offset[t + 1] ? 0 : size[offset[t + 1] - 1];
+			if (final_size < kept.top().first) break;
+		}
+		pair<int, int> now(size_at(t, d), rank[t]);
+		if ((int)kept.size() < k)
+			kept.push(now);
+		else if (Better()(now, kept.top())) {
+			kept.pop();
+			kept.push(now);
+		}
+	}
+
+	vector<int> ans(kept.size());
+	for (int i = (int)kept.size() - 1; i >= 0; i --) {
+		ans[i] = by_rank[kept.top().second];
+		kept.pop();
+	}
+	return ans;
+}
@@ -0,0 +1,40 @@
+//File: tag_timeline.h
+//Date: Sat Oct 17 21:32:40 2026 +0000
+
+
+#pragma once
+#include <vector>
+#include <string>
+#include <utility>
+
+// Largest connected component of every tag, as a function of the
+// birthday threshold of Query 2.
+// A sweep over persons by birthday (descending) only ever grows the
+// components, so each tag is a short list of (date, size) change points,
+// and any (k, d) can be answered without sweeping again.
+class TagTimeline {
+	public:
+		// events[t]: change points of tag t in sweep order, i.e. date
+		// non-increasing and size increasing. consumed.
+		// Data::tag_rank must be ready
+		void build(std::vector<std::vector<std::pair<int, int>>>& events,
+				const std::vector<std::string>& names);
+
+		// largest component of tag, counting persons born on or after d
+		int size_at(int tag, int d) const;
+
+		// top k tags at d: by size descending, then by name. empty if k <= 0
+		std::vector<int> top_k(int k, int d) const;
+
+		const std::string& name(int tag) const { return tag_name[tag]; }
+
+		bool empty() const { return tag_name.empty(); }
+
+	private:
+		std::vector<int> offset;		// change points of tag t: [offset[t], offset[t + 1])
+		std::vector<int> date, size;
+		std::vector<int> order;		// tags by final size descending
+		std::vector<int> rank;		// lexicographic rank of tag names
+		std::vector<int> by_rank;		// inverse of rank
+		std::vector<std::string> tag_name;
+};